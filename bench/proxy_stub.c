@@ -0,0 +1,149 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* a stand-in for an HTTP proxy, for benchmarking and training pulltab on loopback. it accepts any
+ * CONNECT request, and rather than connecting anywhere, the "destination" picks what it does:
+ *
+ *   CONNECT sink:<n>    -- reads and discards everything (bulk upload).
+ *   CONNECT source:<n>  -- sends <n> MiB of data, then closes (bulk download).
+ *   CONNECT echo:<n>    -- echoes everything back (interactive traffic).
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define BUF_SIZE 65536
+#define REQUEST_MAX 4096
+
+#define RESPONSE "HTTP/1.0 200 Connection established\r\n\r\n"
+
+static int write_all(int fd, char *buf, ssize_t len) {
+	while(len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if(n <= 0)
+			return -1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void serve(int fd) {
+	char request[REQUEST_MAX + 1] = "";
+	char target[REQUEST_MAX + 1] = "";
+	int len = 0, arg = 0;
+	ssize_t n;
+
+	/* read the request headers */
+	while(!strstr(request, "\r\n\r\n")) {
+		if(len == REQUEST_MAX)
+			return;
+
+		n = read(fd, request + len, REQUEST_MAX - len);
+		if(n <= 0)
+			return;
+
+		len += n;
+		request[len] = '\0';
+	}
+
+	if(sscanf(request, "CONNECT %[^:]:%d", target, &arg) < 2) {
+		write_all(fd, "HTTP/1.0 400 Bad Request\r\n\r\n", strlen("HTTP/1.0 400 Bad Request\r\n\r\n"));
+		return;
+	}
+
+	if(write_all(fd, RESPONSE, strlen(RESPONSE)) < 0)
+		return;
+
+	static char buf[BUF_SIZE];
+
+	if(!strcmp(target, "sink")) {
+		while(read(fd, buf, BUF_SIZE) > 0)
+			;
+	} else if(!strcmp(target, "source")) {
+		long long remaining = (long long) arg * 1024 * 1024;
+
+		memset(buf, 'x', BUF_SIZE);
+		while(remaining > 0) {
+			n = remaining < BUF_SIZE ? remaining : BUF_SIZE;
+			if(write_all(fd, buf, n) < 0)
+				break;
+			remaining -= n;
+		}
+	} else if(!strcmp(target, "echo")) {
+		while((n = read(fd, buf, BUF_SIZE)) > 0)
+			if(write_all(fd, buf, n) < 0)
+				break;
+	}
+}
+
+int main(int argc, char **argv) {
+	if(argc != 2) {
+		fprintf(stderr, "usage: %s <port>\n", argv[0]);
+		return 1;
+	}
+
+	/* don't leave zombies behind, and don't die if a client goes away */
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(listen_fd < 0) {
+		perror("proxy_stub");
+		return 1;
+	}
+
+	int one = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(atoi(argv[1]));
+
+	if(bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+		perror("proxy_stub");
+		return 1;
+	}
+
+	while(1) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if(fd < 0)
+			continue;
+
+		if(!fork()) {
+			close(listen_fd);
+			serve(fd);
+			close(fd);
+			_exit(0);
+		}
+
+		close(fd);
+	}
+}
@@ -0,0 +1,62 @@
+#!/bin/bash
+# pulltab: tunnel arbitrary streams through HTTP proxies.
+# Copyright (C) 2014 Aleksa Sarai
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Runs a representative loopback workload through pulltab and a local proxy
+# stand-in (bench/proxy_stub.c): bulk upload, bulk download, interactive
+# echo traffic and a burst of short-lived tunnels. Used as the training run
+# for profile-guided builds, and as a rough benchmark.
+#
+# usage: train.sh <pulltab> <proxy_stub> [bulk-MiB]
+
+set -e
+
+PULLTAB="$1"
+STUB="$2"
+BULK_MIB="${3:-256}"
+PORT="${PORT:-18080}"
+
+if [ -z "$PULLTAB" ] || [ -z "$STUB" ]; then
+	echo "usage: $0 <pulltab> <proxy_stub> [bulk-MiB]" >&2
+	exit 1
+fi
+
+WORKDIR="$(mktemp -d)"
+"$STUB" "$PORT" &
+STUB_PID=$!
+trap 'kill $STUB_PID 2>/dev/null; rm -rf "$WORKDIR"' EXIT
+
+# give the stub a moment to start listening
+sleep 0.5
+
+PROXY="127.0.0.1:$PORT"
+printf 'user\0password' > "$WORKDIR/auth"
+
+# keeps pulltab's stdin open (without sending anything) for download runs
+mkfifo "$WORKDIR/hold"
+exec 3<>"$WORKDIR/hold"
+
+echo "bulk upload ($BULK_MIB MiB)"
+time (head -c "${BULK_MIB}M" /dev/zero | "$PULLTAB" -x "$PROXY" -d sink:1 >/dev/null)
+
+echo "bulk download ($BULK_MIB MiB)"
+time ("$PULLTAB" -x "$PROXY" -d "source:$BULK_MIB" <&3 >/dev/null)
+
+echo "interactive (2000 small writes)"
+time (for i in $(seq 2000); do echo "keystroke $i"; sleep 0.001; done | "$PULLTAB" -x "$PROXY" -d echo:1 >/dev/null)
+
+echo "short-lived tunnels (200, with authentication)"
+time (for i in $(seq 200); do echo hello | "$PULLTAB" -a "$WORKDIR/auth" -x "$PROXY" -d echo:1 >/dev/null; done)
@@ -8,7 +8,7 @@ For details, see http://sourceforge.net/projects/libb64
 #ifndef BASE64_CENCODE_H
 #define BASE64_CENCODE_H
 
-#define LENTOBASE64(len) ((((len) * 4) / 3) + (((len) % 3) ? (3 - ((len) % 3)) : 0))
+#define LENTOBASE64(len) ((((len) + 2) / 3) * 4)
 
 typedef enum
 {
@@ -0,0 +1,53 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_COMMON_H
+#define PULLTAB_COMMON_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#define BUF_SIZE 4096
+
+#define DEFAULT_PROXY_PORT 8080
+#define DEFAULT_DEST_PORT  22
+
+#define PORT_UPPER_LIM 65535
+#define PORT_LOWER_LIM 1
+
+#define LENPRINTF(...) (snprintf(NULL, 0, __VA_ARGS__))
+
+/* sets the error returned by tab_strerror() */
+void tab_error(char *fmt, ...);
+
+#if defined(DEBUG)
+__attribute__((unused)) static void _debug(char *fmt, ...) {
+
+	va_list ap;
+	va_start(ap, fmt);
+
+	fprintf(stderr, "[D:pulltab] ");
+	vfprintf(stderr, fmt, ap);
+	fflush(stderr);
+
+	va_end(ap);
+}
+#else
+#	define _debug(...)
+#endif
+
+#endif /* PULLTAB_COMMON_H */
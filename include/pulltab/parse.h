@@ -0,0 +1,48 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_PARSE_H
+#define PULLTAB_PARSE_H
+
+#include "pulltab/common.h"
+
+/* parsed status line of the proxy's response to CONNECT */
+struct proxy_response {
+	int maj;
+	int min;
+	int code;
+	char description[BUF_SIZE];
+};
+
+/* splits a host[:port] spec, filling in default_port if there is no port. returns -1 if the port
+ * is not in the valid range (in which case *hostname is left untouched). */
+int parse_hostport(const char *spec, int default_port, char **hostname, int *port);
+
+/* splits the contents of an auth file (of the form 'user\x00pass'). returns -1 if there is no
+ * NULL separator (in which case *username and *password are left untouched). */
+int parse_auth(char *auth_str, int auth_len, char **username, char **password);
+
+/* parses a response of the form "HTTP/[x.y] [code] [description]" from a NULL-terminated buffer.
+ * returns -1 if it isn't of that form. */
+int parse_proxy_response(char *buf, struct proxy_response *resp);
+
+/* finds the end of the response headers (a blank line, with or without CRs) in the first len bytes
+ * of buf, returning their length or -1 if they haven't ended yet. the response arrives in pieces, so
+ * the first seen bytes (searched when they arrived) aren't searched again. */
+int parse_response_end(char *buf, int len, int seen);
+
+#endif /* PULLTAB_PARSE_H */
@@ -0,0 +1,145 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_PULLTAB_H
+#define PULLTAB_PULLTAB_H
+
+/* libpulltab: the guts of pulltab, for programs which want a tunneled socket without running (and
+ * copying everything through) a pulltab process. typical blocking use looks like:
+ *
+ *     struct tab_opt *opt = tab_opt_new();
+ *     struct tab_conn *conn = tab_conn_new();
+ *
+ *     if(!opt || !conn || tab_opt_set_proxy(opt, "proxy.example.com:3128") < 0 || tab_opt_set_dest(opt, "example.com:22") < 0)
+ *         die(tab_strerror());
+ *
+ *     int fd = tab_connect(opt, conn);
+ *     if(fd < 0)
+ *         die(tab_strerror());
+ *
+ *     ... use fd (or tab_read() and tab_write() if tab_conn_tls(conn) is set) ...
+ *
+ *     tab_conn_free(conn);
+ *     tab_opt_free(opt);
+ *
+ * every function returning an int returns -1 on failure, with a description of the error available
+ * from tab_strerror() (which is per-thread). options and connections are opaque, so that they can
+ * change without breaking programs linked against an older libpulltab. a tab_opt can be used for
+ * any number of connections, including from several threads at once (as long as nobody is changing
+ * it at the time). */
+
+#include <signal.h>
+#include <sys/types.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* libpulltab is built with -fvisibility=hidden, so only what's marked with this is exported */
+#if defined(__GNUC__)
+#	define TAB_EXPORT __attribute__((visibility("default")))
+#else
+#	define TAB_EXPORT
+#endif
+
+#define TAB_DEFAULT_DRAIN_TIMEOUT 10
+
+/* returned by the non-blocking functions, saying what to wait for on the connection's fd before
+ * calling them again */
+enum {
+	TAB_DONE,
+	TAB_WANT_READ,
+	TAB_WANT_WRITE,
+};
+
+/* how (and where) to set up tunnels */
+struct tab_opt;
+
+/* a single tunnel (or an attempt at one) */
+struct tab_conn;
+
+TAB_EXPORT const char *tab_strerror(void);
+
+/* returns NULL if out of memory */
+TAB_EXPORT struct tab_opt *tab_opt_new(void);
+TAB_EXPORT void tab_opt_free(struct tab_opt *opt);
+
+/* host[:port] specs, as given to -x and -d */
+TAB_EXPORT int tab_opt_set_proxy(struct tab_opt *opt, const char *spec);
+TAB_EXPORT int tab_opt_set_dest(struct tab_opt *opt, const char *spec);
+
+/* HTTP basic authentication, either given directly or read from a file of the form 'user\x00pass' */
+TAB_EXPORT int tab_opt_set_auth(struct tab_opt *opt, const char *username, const char *password);
+TAB_EXPORT int tab_opt_set_auth_file(struct tab_opt *opt, const char *path);
+
+/* talk to proxies over TLS, verifying them against the CAs in ca_file (or the defaults, if NULL).
+ * the CAs are loaded straight away, so a bad ca_file is an error here. */
+TAB_EXPORT int tab_opt_set_tls(struct tab_opt *opt, const char *ca_file);
+
+TAB_EXPORT int tab_opt_set_routes(struct tab_opt *opt, const char *path);
+TAB_EXPORT int tab_opt_set_trace(struct tab_opt *opt, const char *path);
+
+/* how long (in seconds) tab_relay() lets the tunnel drain after being asked to shut down */
+TAB_EXPORT int tab_opt_set_drain_timeout(struct tab_opt *opt, int seconds);
+
+/* makes sure the options are complete enough to set up a tunnel with: a destination, and a proxy
+ * (unless routing rules might make one unnecessary) */
+TAB_EXPORT int tab_opt_check(struct tab_opt *opt);
+
+/* returns NULL if out of memory. a tab_conn can be used for one tunnel after another. */
+TAB_EXPORT struct tab_conn *tab_conn_new(void);
+TAB_EXPORT void tab_conn_free(struct tab_conn *conn);
+
+/* the tunnel's socket, or -1 if there isn't one */
+TAB_EXPORT int tab_conn_fd(struct tab_conn *conn);
+
+/* whether the tunnel is over TLS, in which case it must be used through tab_read() and tab_write() */
+TAB_EXPORT int tab_conn_tls(struct tab_conn *conn);
+
+/* sets up a tunnel, returning the (blocking) socket once the proxy has agreed to it */
+TAB_EXPORT int tab_connect(struct tab_opt *opt, struct tab_conn *conn);
+
+/* the same, without blocking (except to resolve hostnames). tab_connect_start() returns TAB_DONE once
+ * the tunnel is ready, or TAB_WANT_READ or TAB_WANT_WRITE -- in which case tab_connect_continue()
+ * should be called once tab_conn_fd(conn) is ready for that. the socket is left in non-blocking mode. */
+TAB_EXPORT int tab_connect_start(struct tab_opt *opt, struct tab_conn *conn);
+TAB_EXPORT int tab_connect_continue(struct tab_opt *opt, struct tab_conn *conn);
+
+/* read(2) and write(2) on the tunnel, going through TLS if it is being used. neither of them (nor
+ * anything else here) raises SIGPIPE if the other end has gone away -- they fail with EPIPE instead. */
+TAB_EXPORT ssize_t tab_read(struct tab_conn *conn, void *buf, size_t len);
+TAB_EXPORT ssize_t tab_write(struct tab_conn *conn, const void *buf, size_t len);
+
+/* relays data between the tunnel and in_fd/out_fd until either side closes, returning -1 if reading
+ * or writing fails. any of them may be non-blocking. if *drain becomes non-zero, in_fd is no longer
+ * read and the tunnel is half-closed, but data from the other end is passed on until it closes the
+ * stream or the drain timeout passes (or *drain goes above 1). writing to out_fd is plain write(2),
+ * so whether a closed out_fd raises SIGPIPE is up to the caller. */
+TAB_EXPORT int tab_relay(struct tab_opt *opt, struct tab_conn *conn, int in_fd, int out_fd, volatile sig_atomic_t *drain);
+
+/* appends the trace line for the tunnel, if tracing is enabled. status is non-zero if it failed. */
+TAB_EXPORT int tab_conn_trace(struct tab_opt *opt, struct tab_conn *conn, int status);
+
+/* closes the tunnel (if any), leaving conn ready for another one. tab_connect_start() does this
+ * itself, and tab_conn_free() does too. */
+TAB_EXPORT void tab_conn_close(struct tab_conn *conn);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* PULLTAB_PULLTAB_H */
@@ -0,0 +1,27 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_RESOLVE_H
+#define PULLTAB_RESOLVE_H
+
+#include <netinet/in.h>
+
+/* resolves a hostname (or address literal) to an IPv4 address, returning -1 (see tab_strerror()) on
+ * failure. unlike gethostbyname(), this is safe to use from several threads at once. */
+int resolve_ipv4(char *hostname, struct in_addr *addr);
+
+#endif /* PULLTAB_RESOLVE_H */
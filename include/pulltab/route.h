@@ -0,0 +1,82 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_ROUTE_H
+#define PULLTAB_ROUTE_H
+
+#include <netinet/in.h>
+
+#define ROUTE_LINE_MAX 1024
+
+enum {
+	ROUTE_DIRECT,
+	ROUTE_PROXY,
+};
+
+/* a single routing decision (shared by every rule which uses it) */
+struct route {
+	int action;
+
+	/* only used for ROUTE_PROXY */
+	char *proxy_hostname;
+	int proxy_port;
+
+	/* the rule as written in the route file, for debugging */
+	char *rule;
+	struct route *next;
+};
+
+/* binary radix trie of IPv4 prefixes, one level per address bit */
+struct route_node {
+	struct route_node *child[2];
+	struct route *route;
+};
+
+/* trie of domain names, one level per label starting from the TLD (so "corp.example.com" is
+ * com -> example -> corp). children are kept sorted by label, for a binary search at each level. */
+struct route_domain {
+	/* lowercased label, or NULL for the root */
+	char *label;
+	struct route *route;
+
+	struct route_domain **children;
+	int num_children;
+};
+
+struct route_table {
+	struct route_node *cidr;
+	struct route_domain *domains;
+
+	/* every route allocated for this table */
+	struct route *routes;
+};
+
+void route_table_init(struct route_table *table);
+void route_table_free(struct route_table *table);
+
+/* loads rules from a route file, returning -1 (see tab_strerror()) on failure */
+int route_table_load(struct route_table *table, const char *path);
+
+/* returns the route for the given destination, or NULL if no rule matches. names are only matched
+ * against domain rules: if none of them match but network rules could, *resolve is set, and it's up
+ * to the caller to resolve the name and try route_lookup_addr(). resolve may be NULL. */
+struct route *route_lookup(struct route_table *table, char *hostname, int *resolve);
+
+/* returns the route for a resolved destination (which only network rules can match), or NULL if no rule matches */
+struct route *route_lookup_addr(struct route_table *table, struct in_addr *addr);
+
+#endif /* PULLTAB_ROUTE_H */
@@ -0,0 +1,68 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_TLS_H
+#define PULLTAB_TLS_H
+
+#include <sys/types.h>
+
+/* TLS client settings and trusted CAs, shared by every session (opaque, since pulltab can be built
+ * without TLS support) */
+struct tab_tls_ctx;
+
+/* TLS session with the proxy (opaque, for the same reason) */
+struct tab_tls;
+
+/* directions handed over to kernel TLS, returned by tls_ktls() */
+enum {
+	TLS_KTLS_SEND = 1 << 0,
+	TLS_KTLS_RECV = 1 << 1,
+};
+
+/* returns whether pulltab was built with TLS support */
+int tls_available(void);
+
+/* sets up the client settings, trusting the CAs in ca_file (or the system defaults if NULL). returns
+ * NULL on failure. */
+struct tab_tls_ctx *tls_ctx_new(const char *ca_file);
+void tls_ctx_free(struct tab_tls_ctx *ctx);
+
+/* sets up a TLS session over the connected socket, verifying the certificate against hostname.
+ * returns NULL on failure. */
+struct tab_tls *tls_start(struct tab_tls_ctx *ctx, int fd, char *hostname);
+
+/* carries on with the handshake, returning TAB_DONE, TAB_WANT_READ, TAB_WANT_WRITE or -1. once it
+ * is done, the session is offloaded to kernel TLS if the kernel supports it. */
+int tls_handshake(struct tab_tls *tls);
+
+/* which directions (TLS_KTLS_*) were offloaded to kernel TLS after the handshake -- the rest is
+ * being encrypted in userspace */
+int tls_ktls(struct tab_tls *tls);
+
+/* these work like read(2), recv(2) with MSG_PEEK and write(2) -- including setting errno to EAGAIN */
+ssize_t tls_read(struct tab_tls *tls, void *buf, size_t len);
+ssize_t tls_peek(struct tab_tls *tls, void *buf, size_t len);
+ssize_t tls_write(struct tab_tls *tls, const void *buf, size_t len);
+
+/* number of bytes already decrypted but not yet read (which poll() won't tell you about) */
+int tls_pending(struct tab_tls *tls);
+
+/* sends close_notify -- the session can still be read from afterwards */
+void tls_shutdown(struct tab_tls *tls);
+void tls_free(struct tab_tls *tls);
+
+#endif /* PULLTAB_TLS_H */
@@ -0,0 +1,69 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_TRACE_H
+#define PULLTAB_TRACE_H
+
+/* phases of a tunnel's life, in the order they (usually) happen */
+enum {
+	TRACE_START,
+	TRACE_ROUTED,
+	TRACE_RESOLVED,
+	TRACE_CONNECTED,
+	TRACE_HANDSHAKE,
+	TRACE_REQUEST_SENT,
+	TRACE_RESPONSE,
+	TRACE_FIRST_UP,
+	TRACE_FIRST_DOWN,
+	TRACE_END,
+	TRACE_MAX,
+};
+
+struct tab_trace {
+	int enabled;
+
+	/* monotonic timestamps (in microseconds) of each phase, or 0 if it never happened */
+	long long stamp[TRACE_MAX];
+
+	/* bytes relayed from stdin to the tunnel (up) and back (down) */
+	long long bytes_up;
+	long long bytes_down;
+
+	/* directions offloaded to kernel TLS (TLS_KTLS_*), or -1 if the proxy wasn't using TLS */
+	int ktls;
+};
+
+/* records the first time a phase is reached. only a single branch when tracing is disabled. */
+#define TRACE_STAMP(trace, phase) \
+	do { \
+		if((trace)->enabled && !(trace)->stamp[(phase)]) \
+			trace_stamp((trace), (phase)); \
+	} while(0)
+
+#define TRACE_BYTES(trace, field, len) \
+	do { \
+		if((trace)->enabled) \
+			(trace)->field += (len); \
+	} while(0)
+
+void trace_init(struct tab_trace *trace);
+void trace_stamp(struct tab_trace *trace, int phase);
+
+/* appends a single key=value trace line for the tunnel to the given file */
+int trace_write(struct tab_trace *trace, char *path, char *dest, char *via, int status);
+
+#endif /* PULLTAB_TRACE_H */
@@ -0,0 +1,84 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULLTAB_TUNNEL_H
+#define PULLTAB_TUNNEL_H
+
+/* the insides of the (opaque) tab_opt and tab_conn, which only libpulltab itself gets to see */
+
+#include "pulltab/pulltab.h"
+#include "pulltab/route.h"
+#include "pulltab/trace.h"
+#include "pulltab/tls.h"
+
+/* largest proxy response (status line and headers) we accept */
+#define TAB_RESPONSE_MAX 4096
+
+enum {
+	AUTH_NONE,
+	AUTH_BASIC,
+};
+
+struct tab_opt {
+	/* proxy server options */
+	char *proxy_hostname;
+	int proxy_port;
+
+	/* talk to the proxy over TLS if set (with the CAs to trust already loaded into it) */
+	struct tab_tls_ctx *tls_ctx;
+
+	/* proxy credentials (if applicable) */
+	int proxy_auth;
+	char *auth_username;
+	char *auth_password;
+
+	/* destination */
+	char *dest_hostname;
+	int dest_port;
+
+	/* per-destination routing rules */
+	struct route_table routes;
+
+	/* how long (in seconds) to let the relay drain after being asked to shut down */
+	int drain_timeout;
+
+	/* where to append per-phase latency traces (if enabled) */
+	char *trace_path;
+};
+
+struct tab_conn {
+	/* the tunnel -- if tls is set, it must be used through tab_read() and tab_write() */
+	int fd;
+	struct tab_tls *tls;
+
+	/* how the destination is being reached (via_hostname belongs to the tab_opt) */
+	int direct;
+	char *via_hostname;
+	int via_port;
+
+	/* per-phase latency of this tunnel (if opt->trace_path is set) */
+	struct tab_trace trace;
+
+	/* handshake progress */
+	int state;
+	char *request;
+	int request_len, request_off;
+	char response[TAB_RESPONSE_MAX];
+	int response_len;
+};
+
+#endif /* PULLTAB_TUNNEL_H */
@@ -0,0 +1,43 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "pulltab/common.h"
+#include "pulltab/pulltab.h"
+
+/* the library doesn't print anything itself, so that it can be embedded -- errors are kept here
+ * (per-thread) for the caller to report however it likes */
+static _Thread_local char tab_errbuf[BUF_SIZE] = "";
+
+void tab_error(char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+
+	vsnprintf(tab_errbuf, BUF_SIZE, fmt, ap);
+	_debug("error: %s\n", tab_errbuf);
+
+	va_end(ap);
+}
+
+const char *tab_strerror(void) {
+	return tab_errbuf;
+}
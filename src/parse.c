@@ -0,0 +1,114 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+
+int parse_hostport(const char *spec, int default_port, char **hostname, int *port) {
+	int spec_len = strlen(spec);
+
+	/* look for host:port separator */
+	int hlen = spec_len;
+	const char *sep = memchr(spec, ':', spec_len);
+
+	/* deal with optional port number */
+	int spec_port = default_port;
+	if(sep) {
+		hlen = sep - spec;
+		spec_port = atoi(sep + 1);
+	}
+
+	/* make sure port number is valid */
+	if(spec_port < PORT_LOWER_LIM || spec_port > PORT_UPPER_LIM)
+		return -1;
+
+	/* copy hostname over */
+	*hostname = malloc(hlen + 1);
+	memcpy(*hostname, spec, hlen);
+	(*hostname)[hlen] = '\0';
+
+	*port = spec_port;
+	return 0;
+}
+
+int parse_auth(char *auth_str, int auth_len, char **username, char **password) {
+	if(!auth_str || auth_len <= 0)
+		return -1;
+
+	/* find null separator in auth spec */
+	char *auth_sep = memchr(auth_str, '\0', auth_len);
+	if(!auth_sep)
+		return -1;
+
+	/* calculate length and offsets of username:password in string */
+	int auth_ulen = auth_sep - auth_str;
+	int auth_plen = auth_len - (auth_ulen + 1);
+
+	/* copy over username */
+	*username = malloc(auth_ulen + 1);
+	strncpy(*username, auth_str, auth_ulen);
+	(*username)[auth_ulen] = '\0';
+
+	/* copy over password (anything after another NULL byte is dropped) */
+	*password = malloc(auth_plen + 1);
+	strncpy(*password, auth_str + (auth_ulen + 1), auth_plen);
+	(*password)[auth_plen] = '\0';
+
+	return 0;
+}
+
+int parse_proxy_response(char *buf, struct proxy_response *resp) {
+	resp->maj = 0;
+	resp->min = 0;
+	resp->code = 0;
+	resp->description[0] = '\0';
+
+	/* the description can't be longer than the buffer, so it'll always fit (if buf fits in BUF_SIZE) */
+	if(strlen(buf) >= BUF_SIZE)
+		return -1;
+
+	if(sscanf(buf, "HTTP/%d.%d %d %[^\n]", &resp->maj, &resp->min, &resp->code, resp->description) < 4)
+		return -1;
+
+	return 0;
+}
+
+int parse_response_end(char *buf, int len, int seen) {
+	int i;
+
+	/* whether a newline ends the headers only depends on what came before it, so anything already
+	 * searched can't have changed its mind */
+	for(i = seen > 0 ? seen : 0; i < len; i++) {
+		if(buf[i] != '\n')
+			continue;
+
+		/* accept bare newlines as well as CRLFs */
+		if(i >= 1 && buf[i - 1] == '\n')
+			return i + 1;
+		if(i >= 3 && !memcmp(buf + i - 3, "\r\n\r\n", 4))
+			return i + 1;
+	}
+
+	return -1;
+}
@@ -0,0 +1,55 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "pulltab/common.h"
+#include "pulltab/resolve.h"
+
+int resolve_ipv4(char *hostname, struct in_addr *addr) {
+	struct addrinfo hints, *res = NULL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int err = getaddrinfo(hostname, NULL, &hints, &res);
+	if(err) {
+		tab_error("could not resolve '%s': %s", hostname, err == EAI_SYSTEM ? strerror(errno) : gai_strerror(err));
+		return -1;
+	}
+
+	*addr = ((struct sockaddr_in *) res->ai_addr)->sin_addr;
+	freeaddrinfo(res);
+
+#if defined(DEBUG)
+	char ip[INET_ADDRSTRLEN];
+	_debug("resolved '%s' to %s\n", hostname, inet_ntop(AF_INET, addr, ip, sizeof(ip)));
+#endif
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+#include "pulltab/pulltab.h"
+#include "pulltab/route.h"
+
+#define ROUTE_WHITESPACE " \t\r\n"
+
+void route_table_init(struct route_table *table) {
+	table->cidr = NULL;
+	table->domains = NULL;
+	table->routes = NULL;
+}
+
+static void route_node_free(struct route_node *node) {
+	if(!node)
+		return;
+
+	route_node_free(node->child[0]);
+	route_node_free(node->child[1]);
+	free(node);
+}
+
+static void route_domain_free(struct route_domain *domain) {
+	int i;
+
+	if(!domain)
+		return;
+
+	for(i = 0; i < domain->num_children; i++)
+		route_domain_free(domain->children[i]);
+
+	free(domain->children);
+	free(domain->label);
+	free(domain);
+}
+
+void route_table_free(struct route_table *table) {
+	route_node_free(table->cidr);
+
+	route_domain_free(table->domains);
+
+	while(table->routes) {
+		struct route *next = table->routes->next;
+		free(table->routes->proxy_hostname);
+		free(table->routes->rule);
+		free(table->routes);
+		table->routes = next;
+	}
+
+	route_table_init(table);
+}
+
+/* insert the top plen bits of addr (host order) into the trie. later rules override earlier ones. */
+static void route_insert_cidr(struct route_table *table, unsigned long addr, int plen, struct route *route) {
+	struct route_node **node = &table->cidr;
+	int i;
+
+	for(i = 0; ; i++) {
+		if(!*node)
+			*node = calloc(1, sizeof(struct route_node));
+
+		if(i == plen)
+			break;
+
+		node = &(*node)->child[(addr >> (31 - i)) & 1];
+	}
+
+	(*node)->route = route;
+}
+
+/* compares the len bytes at key against a (lowercased) label, ignoring the case of key */
+static int route_label_cmp(char *key, int len, char *label) {
+	int i;
+
+	for(i = 0; i < len && label[i]; i++) {
+		int diff = tolower((unsigned char) key[i]) - (unsigned char) label[i];
+		if(diff)
+			return diff;
+	}
+
+	if(i < len)
+		return 1;
+	if(label[i])
+		return -1;
+	return 0;
+}
+
+/* binary search for the child of domain with the given label, returning its index if found. if it
+ * isn't, returns -1 and sets *pos (if given) to where it should be inserted. */
+static int route_domain_find(struct route_domain *domain, char *key, int len, int *pos) {
+	int lo = 0, hi = domain->num_children;
+
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int cmp = route_label_cmp(key, len, domain->children[mid]->label);
+
+		if(!cmp)
+			return mid;
+		if(cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	if(pos)
+		*pos = lo;
+	return -1;
+}
+
+/* returns the length of the label in name which ends just before end */
+static int route_label_prev(char *name, int end) {
+	int start = end;
+
+	while(start > 0 && name[start - 1] != '.')
+		start--;
+
+	return end - start;
+}
+
+/* insert a domain suffix into the trie. later rules override earlier ones. */
+static void route_insert_domain(struct route_table *table, char *suffix, struct route *route) {
+	struct route_domain *node;
+	int end = strlen(suffix);
+
+	if(!table->domains)
+		table->domains = calloc(1, sizeof(struct route_domain));
+	node = table->domains;
+
+	/* leading dots are implied by matching on label boundaries, and trailing ones are the root */
+	while(*suffix == '.') {
+		suffix++;
+		end--;
+	}
+	while(end > 0 && suffix[end - 1] == '.')
+		end--;
+
+	/* walk down from the TLD, creating labels as needed */
+	while(end > 0) {
+		int len = route_label_prev(suffix, end), pos, i;
+		char *key = suffix + end - len;
+
+		i = route_domain_find(node, key, len, &pos);
+		if(i < 0) {
+			struct route_domain *child = calloc(1, sizeof(struct route_domain));
+			child->label = strndup(key, len);
+			for(i = 0; i < len; i++)
+				child->label[i] = tolower((unsigned char) child->label[i]);
+
+			node->children = realloc(node->children, (node->num_children + 1) * sizeof(struct route_domain *));
+			memmove(node->children + pos + 1, node->children + pos, (node->num_children - pos) * sizeof(struct route_domain *));
+			node->children[pos] = child;
+			node->num_children++;
+			i = pos;
+		}
+
+		node = node->children[i];
+		end -= len + 1;
+	}
+
+	node->route = route;
+}
+
+/* longest-prefix match of addr (host order) */
+static struct route *route_lookup_cidr(struct route_table *table, unsigned long addr) {
+	struct route_node *node = table->cidr;
+	struct route *match = NULL;
+	int i;
+
+	for(i = 0; node; i++) {
+		if(node->route)
+			match = node->route;
+
+		if(i == 32)
+			break;
+
+		node = node->child[(addr >> (31 - i)) & 1];
+	}
+
+	return match;
+}
+
+/* longest-suffix match of hostname, on label boundaries */
+static struct route *route_lookup_domain(struct route_table *table, char *hostname) {
+	struct route_domain *node = table->domains;
+	struct route *match = NULL;
+	int end = strlen(hostname);
+
+	/* ignore the root label of fully-qualified names */
+	if(end > 0 && hostname[end - 1] == '.')
+		end--;
+
+	while(node) {
+		if(node->route)
+			match = node->route;
+
+		if(end <= 0)
+			break;
+
+		int len = route_label_prev(hostname, end);
+		int i = route_domain_find(node, hostname + end - len, len, NULL);
+
+		node = i < 0 ? NULL : node->children[i];
+		end -= len + 1;
+	}
+
+	return match;
+}
+
+static struct route *route_parse_action(struct route_table *table, char *rule, char **saveptr) {
+	char *action = strtok_r(NULL, ROUTE_WHITESPACE, saveptr);
+	if(!action) {
+		tab_error("invalid route '%s': missing action", rule);
+		return NULL;
+	}
+
+	struct route *route = calloc(1, sizeof(struct route));
+	route->rule = strdup(rule);
+
+	/* add to list of routes so it gets freed along with the table */
+	route->next = table->routes;
+	table->routes = route;
+
+	if(!strcmp(action, "direct")) {
+		route->action = ROUTE_DIRECT;
+	} else if(!strcmp(action, "proxy")) {
+		char *proxy = strtok_r(NULL, ROUTE_WHITESPACE, saveptr);
+		if(!proxy) {
+			tab_error("invalid route '%s': missing proxy specification", rule);
+			return NULL;
+		}
+
+		if(parse_hostport(proxy, DEFAULT_PROXY_PORT, &route->proxy_hostname, &route->proxy_port) < 0) {
+			tab_error("invalid route '%s': proxy port is not in valid range", rule);
+			return NULL;
+		}
+
+		route->action = ROUTE_PROXY;
+	} else {
+		tab_error("invalid route '%s': unknown action '%s'", rule, action);
+		return NULL;
+	}
+
+	if(strtok_r(NULL, ROUTE_WHITESPACE, saveptr)) {
+		tab_error("invalid route '%s': trailing garbage", rule);
+		return NULL;
+	}
+
+	return route;
+}
+
+static int route_parse_line(struct route_table *table, char *line) {
+	char rule[ROUTE_LINE_MAX];
+	char *saveptr = NULL;
+
+	/* strip comments */
+	char *comment = strchr(line, '#');
+	if(comment)
+		*comment = '\0';
+
+	/* keep a copy of the rule for error messages */
+	strncpy(rule, line, ROUTE_LINE_MAX - 1);
+	rule[ROUTE_LINE_MAX - 1] = '\0';
+	rule[strcspn(rule, "\r\n")] = '\0';
+
+	char *match = strtok_r(line, ROUTE_WHITESPACE, &saveptr);
+	if(!match)
+		return 0;
+
+	struct route *route = route_parse_action(table, rule, &saveptr);
+	if(!route)
+		return -1;
+
+	/* deal with optional prefix length */
+	long plen = 32;
+	char *plen_sep = strchr(match, '/');
+	if(plen_sep) {
+		char *end = NULL;
+
+		*plen_sep = '\0';
+		errno = 0;
+		plen = strtol(plen_sep + 1, &end, 10);
+
+		/* don't let a typo turn into a catch-all /0 */
+		if(!isdigit((unsigned char) plen_sep[1]) || errno || *end || plen < 0 || plen > 32) {
+			tab_error("invalid route '%s': prefix length is not in valid range", rule);
+			return -1;
+		}
+	}
+
+	struct in_addr addr;
+	if(inet_aton(match, &addr)) {
+		/* mask out host bits, so a sloppy 10.1.2.3/8 still means 10.0.0.0/8 */
+		unsigned long host = ntohl(addr.s_addr);
+		if(plen < 32)
+			host &= ~(0xffffffffUL >> plen) & 0xffffffffUL;
+
+		route_insert_cidr(table, host, plen, route);
+	} else if(plen_sep) {
+		tab_error("invalid route '%s': bad network address", rule);
+		return -1;
+	} else {
+		route_insert_domain(table, match, route);
+	}
+
+	return 0;
+}
+
+int route_table_load(struct route_table *table, const char *path) {
+	FILE *route_file = fopen(path, "r");
+	if(!route_file) {
+		tab_error("could not open route file '%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	char line[ROUTE_LINE_MAX];
+	int lineno = 0;
+
+	while(fgets(line, ROUTE_LINE_MAX, route_file)) {
+		lineno++;
+
+		/* fgets() splits long lines, and the rest mustn't be read as a rule of its own (which could
+		 * even come from a commented-out line) -- so only the last line may lack a newline */
+		if(!strchr(line, '\n') && getc(route_file) != EOF) {
+			tab_error("error in route file '%s' on line %d: line too long (the limit is %d characters)", path, lineno, ROUTE_LINE_MAX - 2);
+			fclose(route_file);
+			return -1;
+		}
+
+		if(route_parse_line(table, line) < 0) {
+			char msg[BUF_SIZE];
+			snprintf(msg, BUF_SIZE, "%s", tab_strerror());
+
+			tab_error("error in route file '%s' on line %d: %s", path, lineno, msg);
+			fclose(route_file);
+			return -1;
+		}
+	}
+
+	fclose(route_file);
+	_debug("loaded route file '%s' (%d lines)\n", path, lineno);
+	return 0;
+}
+
+struct route *route_lookup(struct route_table *table, char *hostname, int *resolve) {
+	struct route *route = NULL;
+	struct in_addr literal;
+
+	if(resolve)
+		*resolve = 0;
+
+	/* address literals can only match network rules */
+	if(inet_aton(hostname, &literal))
+		return route_lookup_addr(table, &literal);
+
+	route = route_lookup_domain(table, hostname);
+
+	/* falling back to the resolved address is only worth it if it could matter */
+	if(!route && table->cidr && resolve)
+		*resolve = 1;
+
+	if(route) {
+		_debug("routing '%s' via rule '%s'\n", hostname, route->rule);
+	} else {
+		_debug("no route rule matched '%s'\n", hostname);
+	}
+
+	return route;
+}
+
+struct route *route_lookup_addr(struct route_table *table, struct in_addr *addr) {
+	struct route *route = route_lookup_cidr(table, ntohl(addr->s_addr));
+
+	if(route) {
+		_debug("routing '%s' via rule '%s'\n", inet_ntoa(*addr), route->rule);
+	} else {
+		_debug("no route rule matched '%s'\n", inet_ntoa(*addr));
+	}
+
+	return route;
+}
@@ -0,0 +1,375 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+#include "pulltab/common.h"
+#include "pulltab/pulltab.h"
+#include "pulltab/tls.h"
+
+#if defined(WITH_TLS)
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+struct tab_tls_ctx {
+	SSL_CTX *ctx;
+};
+
+struct tab_tls {
+	SSL *ssl;
+};
+
+static void tls_error(char *msg) {
+	unsigned long err = ERR_get_error();
+	const char *reason = ERR_reason_error_string(err);
+
+	/* OpenSSL has no string for failed system calls (like opening a missing CA file) */
+#if defined(ERR_SYSTEM_ERROR)
+	if(err && ERR_SYSTEM_ERROR(err))
+		reason = strerror(ERR_GET_REASON(err));
+#endif
+
+	if(reason)
+		tab_error("%s: %s", msg, reason);
+	else
+		tab_error("%s", msg);
+
+	ERR_clear_error();
+}
+
+/* OpenSSL writes to the socket with write(2) (or sendmsg(2) with kernel TLS), which raises SIGPIPE if
+ * the proxy has gone away. so SIGPIPE is blocked around anything which might write, and any that it
+ * raised is taken back before unblocking it, leaving the caller with just EPIPE. */
+struct tls_sigpipe {
+	sigset_t mask;
+	int pending;
+};
+
+static void tls_sigpipe_block(struct tls_sigpipe *sp) {
+	sigset_t pipe_set, pending;
+
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+
+	/* one that was already pending isn't ours to take */
+	sigpending(&pending);
+	sp->pending = sigismember(&pending, SIGPIPE);
+
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &sp->mask);
+}
+
+static void tls_sigpipe_unblock(struct tls_sigpipe *sp) {
+	sigset_t pipe_set, pending;
+	int saved_errno = errno;
+
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+
+	if(!sp->pending && !sigpending(&pending) && sigismember(&pending, SIGPIPE)) {
+		struct timespec zero = { 0, 0 };
+		sigtimedwait(&pipe_set, NULL, &zero);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &sp->mask, NULL);
+	errno = saved_errno;
+}
+
+int tls_available(void) {
+	return 1;
+}
+
+struct tab_tls_ctx *tls_ctx_new(const char *ca_file) {
+	struct tab_tls_ctx *ctx = calloc(1, sizeof(struct tab_tls_ctx));
+	if(!ctx) {
+		tab_error("could not allocate TLS context: %s", strerror(errno));
+		return NULL;
+	}
+
+	ctx->ctx = SSL_CTX_new(TLS_client_method());
+	if(!ctx->ctx) {
+		tls_error("could not set up TLS context");
+		goto error;
+	}
+
+	/* hand the session keys to the kernel once the handshake is done (if it can take them) */
+	SSL_CTX_set_options(ctx->ctx, SSL_OP_ENABLE_KTLS);
+	SSL_CTX_set_min_proto_version(ctx->ctx, TLS1_2_VERSION);
+	SSL_CTX_set_verify(ctx->ctx, SSL_VERIFY_PEER, NULL);
+
+	/* load trusted certificates (once, rather than for every tunnel) */
+	if(ca_file) {
+		if(!SSL_CTX_load_verify_locations(ctx->ctx, ca_file, NULL)) {
+			tls_error("could not load CA file");
+			goto error;
+		}
+	} else if(!SSL_CTX_set_default_verify_paths(ctx->ctx)) {
+		tls_error("could not load default CAs");
+		goto error;
+	}
+
+	return ctx;
+
+error:
+	tls_ctx_free(ctx);
+	return NULL;
+}
+
+void tls_ctx_free(struct tab_tls_ctx *ctx) {
+	if(!ctx)
+		return;
+
+	SSL_CTX_free(ctx->ctx);
+	free(ctx);
+}
+
+struct tab_tls *tls_start(struct tab_tls_ctx *ctx, int fd, char *hostname) {
+	struct tab_tls *tls = calloc(1, sizeof(struct tab_tls));
+	if(!tls) {
+		tab_error("could not allocate TLS session: %s", strerror(errno));
+		return NULL;
+	}
+
+	/* the session keeps its own reference to the context */
+	tls->ssl = SSL_new(ctx->ctx);
+	if(!tls->ssl || !SSL_set_fd(tls->ssl, fd)) {
+		tls_error("could not set up TLS session");
+		goto error;
+	}
+
+	/* check the certificate matches the proxy (and send SNI for it) */
+	SSL_set_hostflags(tls->ssl, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+	if(!SSL_set1_host(tls->ssl, hostname)) {
+		tls_error("could not set TLS hostname");
+		goto error;
+	}
+	SSL_set_tlsext_host_name(tls->ssl, hostname);
+
+	return tls;
+
+error:
+	tls_free(tls);
+	return NULL;
+}
+
+int tls_handshake(struct tab_tls *tls) {
+	struct tls_sigpipe sp;
+
+	tls_sigpipe_block(&sp);
+	int ret = SSL_connect(tls->ssl);
+	tls_sigpipe_unblock(&sp);
+
+	if(ret != 1) {
+		switch(SSL_get_error(tls->ssl, ret)) {
+			case SSL_ERROR_WANT_READ:
+				return TAB_WANT_READ;
+			case SSL_ERROR_WANT_WRITE:
+				return TAB_WANT_WRITE;
+		}
+
+		long verify = SSL_get_verify_result(tls->ssl);
+		if(verify != X509_V_OK)
+			tab_error("could not verify proxy certificate: %s", X509_verify_cert_error_string(verify));
+		else
+			tls_error("TLS handshake with proxy failed");
+		return -1;
+	}
+
+	_debug("negotiated %s (%s) with proxy\n", SSL_get_version(tls->ssl), SSL_get_cipher(tls->ssl));
+	_debug("kernel TLS offload: send %s, recv %s\n",
+			tls_ktls(tls) & TLS_KTLS_SEND ? "on" : "off",
+			tls_ktls(tls) & TLS_KTLS_RECV ? "on" : "off");
+
+	return TAB_DONE;
+}
+
+int tls_ktls(struct tab_tls *tls) {
+	int ktls = 0;
+
+	if(BIO_get_ktls_send(SSL_get_wbio(tls->ssl)))
+		ktls |= TLS_KTLS_SEND;
+	if(BIO_get_ktls_recv(SSL_get_rbio(tls->ssl)))
+		ktls |= TLS_KTLS_RECV;
+
+	return ktls;
+}
+
+/* map OpenSSL's return values onto read(2) and write(2) semantics */
+static ssize_t tls_result(struct tab_tls *tls, int ret) {
+	if(ret > 0)
+		return ret;
+
+	switch(SSL_get_error(tls->ssl, ret)) {
+		case SSL_ERROR_ZERO_RETURN:
+			return 0;
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			errno = EAGAIN;
+			return -1;
+		case SSL_ERROR_SYSCALL:
+			/* unexpected EOF from the proxy */
+			if(!errno)
+				return 0;
+			return -1;
+		default:
+			tls_error("TLS error");
+			errno = EPROTO;
+			return -1;
+	}
+}
+
+ssize_t tls_read(struct tab_tls *tls, void *buf, size_t len) {
+	struct tls_sigpipe sp;
+
+	errno = 0;
+	tls_sigpipe_block(&sp);
+	int ret = SSL_read(tls->ssl, buf, len);
+	tls_sigpipe_unblock(&sp);
+
+	return tls_result(tls, ret);
+}
+
+ssize_t tls_peek(struct tab_tls *tls, void *buf, size_t len) {
+	struct tls_sigpipe sp;
+
+	errno = 0;
+	tls_sigpipe_block(&sp);
+	int ret = SSL_peek(tls->ssl, buf, len);
+	tls_sigpipe_unblock(&sp);
+
+	return tls_result(tls, ret);
+}
+
+ssize_t tls_write(struct tab_tls *tls, const void *buf, size_t len) {
+	struct tls_sigpipe sp;
+
+	errno = 0;
+	tls_sigpipe_block(&sp);
+	int ret = SSL_write(tls->ssl, buf, len);
+	tls_sigpipe_unblock(&sp);
+
+	return tls_result(tls, ret);
+}
+
+int tls_pending(struct tab_tls *tls) {
+	return SSL_pending(tls->ssl);
+}
+
+void tls_shutdown(struct tab_tls *tls) {
+	struct tls_sigpipe sp;
+
+	tls_sigpipe_block(&sp);
+	SSL_shutdown(tls->ssl);
+	tls_sigpipe_unblock(&sp);
+}
+
+void tls_free(struct tab_tls *tls) {
+	if(!tls)
+		return;
+
+	SSL_free(tls->ssl);
+	free(tls);
+}
+
+#else
+
+int tls_available(void) {
+	return 0;
+}
+
+struct tab_tls_ctx *tls_ctx_new(const char *ca_file) {
+	(void) ca_file;
+
+	tab_error("built without TLS support");
+	return NULL;
+}
+
+void tls_ctx_free(struct tab_tls_ctx *ctx) {
+	(void) ctx;
+}
+
+struct tab_tls *tls_start(struct tab_tls_ctx *ctx, int fd, char *hostname) {
+	(void) ctx;
+	(void) fd;
+	(void) hostname;
+
+	tab_error("built without TLS support");
+	return NULL;
+}
+
+int tls_handshake(struct tab_tls *tls) {
+	(void) tls;
+
+	tab_error("built without TLS support");
+	return -1;
+}
+
+int tls_ktls(struct tab_tls *tls) {
+	(void) tls;
+	return 0;
+}
+
+ssize_t tls_read(struct tab_tls *tls, void *buf, size_t len) {
+	(void) tls;
+	(void) buf;
+	(void) len;
+
+	errno = ENOSYS;
+	return -1;
+}
+
+ssize_t tls_peek(struct tab_tls *tls, void *buf, size_t len) {
+	(void) tls;
+	(void) buf;
+	(void) len;
+
+	errno = ENOSYS;
+	return -1;
+}
+
+ssize_t tls_write(struct tab_tls *tls, const void *buf, size_t len) {
+	(void) tls;
+	(void) buf;
+	(void) len;
+
+	errno = ENOSYS;
+	return -1;
+}
+
+int tls_pending(struct tab_tls *tls) {
+	(void) tls;
+	return 0;
+}
+
+void tls_shutdown(struct tab_tls *tls) {
+	(void) tls;
+}
+
+void tls_free(struct tab_tls *tls) {
+	(void) tls;
+}
+
+#endif
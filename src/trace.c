@@ -0,0 +1,124 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "pulltab/common.h"
+#include "pulltab/trace.h"
+#include "pulltab/tls.h"
+
+#define TRACE_LINE_MAX 1024
+
+/* names of each phase's offset in the trace line */
+static char *trace_phase_names[TRACE_MAX] = {
+	[TRACE_START]        = "start",
+	[TRACE_ROUTED]       = "route_us",
+	[TRACE_RESOLVED]     = "resolve_us",
+	[TRACE_CONNECTED]    = "connect_us",
+	[TRACE_HANDSHAKE]    = "tls_us",
+	[TRACE_REQUEST_SENT] = "request_us",
+	[TRACE_RESPONSE]     = "response_us",
+	[TRACE_FIRST_UP]     = "first_up_us",
+	[TRACE_FIRST_DOWN]   = "first_down_us",
+	[TRACE_END]          = "total_us",
+};
+
+void trace_init(struct tab_trace *trace) {
+	memset(trace, 0, sizeof(struct tab_trace));
+	trace->ktls = -1;
+}
+
+void trace_stamp(struct tab_trace *trace, int phase) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	/* 0 means "never happened", so don't let a phase land on it */
+	trace->stamp[phase] = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL + 1;
+}
+
+int trace_write(struct tab_trace *trace, char *path, char *dest, char *via, int status) {
+	char line[TRACE_LINE_MAX];
+	int len, phase;
+
+	/* nothing to say if a tunnel was never attempted (such as for -h, or bad arguments) */
+	if(!trace->enabled || !trace->stamp[TRACE_START])
+		return 0;
+
+	TRACE_STAMP(trace, TRACE_END);
+
+	len = snprintf(line, TRACE_LINE_MAX, "pulltab-trace pid=%d dest=%s via=%s status=%s start=%lld",
+			(int) getpid(), dest, via, status ? "error" : "ok", trace->stamp[TRACE_START]);
+
+	/* every other phase is an offset from the start, or -1 if it was never reached */
+	for(phase = TRACE_START + 1; phase < TRACE_MAX && len < TRACE_LINE_MAX; phase++) {
+		long long offset = -1;
+		if(trace->stamp[phase])
+			offset = trace->stamp[phase] - trace->stamp[TRACE_START];
+
+		len += snprintf(line + len, TRACE_LINE_MAX - len, " %s=%lld", trace_phase_names[phase], offset);
+	}
+
+	/* say whether TLS fell back to userspace, since that's where the time goes if it did */
+	if(trace->ktls >= 0 && len < TRACE_LINE_MAX) {
+		char *ktls = "off";
+		if((trace->ktls & TLS_KTLS_SEND) && (trace->ktls & TLS_KTLS_RECV))
+			ktls = "send,recv";
+		else if(trace->ktls & TLS_KTLS_SEND)
+			ktls = "send";
+		else if(trace->ktls & TLS_KTLS_RECV)
+			ktls = "recv";
+
+		len += snprintf(line + len, TRACE_LINE_MAX - len, " ktls=%s", ktls);
+	}
+
+	if(len < TRACE_LINE_MAX)
+		len += snprintf(line + len, TRACE_LINE_MAX - len, " bytes_up=%lld bytes_down=%lld\n", trace->bytes_up, trace->bytes_down);
+
+	/* make sure the line is terminated, even if it had to be truncated */
+	if(len >= TRACE_LINE_MAX) {
+		len = TRACE_LINE_MAX - 1;
+		line[len - 1] = '\n';
+	}
+
+	/* lines are written with a single append, so many tunnels can share a trace file */
+	int trace_fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if(trace_fd < 0) {
+		tab_error("could not open trace file '%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	if(write(trace_fd, line, len) != len) {
+		tab_error("could not write trace file '%s': %s", path, strerror(errno));
+		close(trace_fd);
+		return -1;
+	}
+
+	close(trace_fd);
+	return 0;
+}
@@ -0,0 +1,889 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "b64/cencode.h"
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+#include "pulltab/pulltab.h"
+#include "pulltab/resolve.h"
+#include "pulltab/tunnel.h"
+
+#define CRLF "\r\n\r\n"
+#define HTTP_VERSION "1.0"
+#define PROXY_CONNECT_FORMAT "CONNECT %s:%d HTTP/" HTTP_VERSION
+#define PROXY_BASIC_AUTH_FORMAT "\nProxy-Authorization: Basic %s"
+#define PROXY_BASIC_AUTH_SEPARATOR ":"
+
+/* how long (in seconds) tab_connect() waits for each step of the handshake with the proxy */
+#define HANDSHAKE_TIMEOUT 5
+
+/* where a tab_conn is in setting up the tunnel */
+enum {
+	STATE_INIT,
+	STATE_CONNECTING,
+	STATE_TLS_HANDSHAKE,
+	STATE_REQUEST,
+	STATE_RESPONSE,
+	STATE_DONE,
+};
+
+static void tab_opt_init(struct tab_opt *opt) {
+	opt->proxy_hostname = NULL;
+	opt->proxy_port = DEFAULT_PROXY_PORT;
+	opt->tls_ctx = NULL;
+	opt->proxy_auth = AUTH_NONE;
+	opt->auth_username = NULL;
+	opt->auth_password = NULL;
+	opt->dest_hostname = NULL;
+	opt->dest_port = DEFAULT_DEST_PORT;
+	route_table_init(&opt->routes);
+	opt->drain_timeout = TAB_DEFAULT_DRAIN_TIMEOUT;
+	opt->trace_path = NULL;
+}
+
+struct tab_opt *tab_opt_new(void) {
+	struct tab_opt *opt = malloc(sizeof(struct tab_opt));
+	if(!opt) {
+		tab_error("could not allocate options: %s", strerror(errno));
+		return NULL;
+	}
+
+	tab_opt_init(opt);
+	return opt;
+}
+
+void tab_opt_free(struct tab_opt *opt) {
+	if(!opt)
+		return;
+
+	free(opt->proxy_hostname);
+	tls_ctx_free(opt->tls_ctx);
+	free(opt->auth_username);
+	free(opt->auth_password);
+	free(opt->dest_hostname);
+	route_table_free(&opt->routes);
+	free(opt->trace_path);
+	free(opt);
+}
+
+int tab_opt_set_proxy(struct tab_opt *opt, const char *spec) {
+	free(opt->proxy_hostname);
+	opt->proxy_hostname = NULL;
+
+	if(parse_hostport(spec, DEFAULT_PROXY_PORT, &opt->proxy_hostname, &opt->proxy_port) < 0) {
+		tab_error("invalid proxy specification: proxy port is not in valid range");
+		return -1;
+	}
+
+	return 0;
+}
+
+int tab_opt_set_dest(struct tab_opt *opt, const char *spec) {
+	free(opt->dest_hostname);
+	opt->dest_hostname = NULL;
+
+	if(parse_hostport(spec, DEFAULT_DEST_PORT, &opt->dest_hostname, &opt->dest_port) < 0) {
+		tab_error("invalid dest specification: dest port is not in valid range");
+		return -1;
+	}
+
+	return 0;
+}
+
+int tab_opt_set_auth(struct tab_opt *opt, const char *username, const char *password) {
+	free(opt->auth_username);
+	free(opt->auth_password);
+
+	/* activate proxy auth */
+	opt->proxy_auth = AUTH_BASIC;
+	opt->auth_username = strdup(username);
+	opt->auth_password = strdup(password);
+
+	_debug("got HTTP basic authentication username '%s'\n", opt->auth_username);
+	_debug("got HTTP basic authentication password '%s'\n", opt->auth_password);
+	return 0;
+}
+
+int tab_opt_set_auth_file(struct tab_opt *opt, const char *path) {
+	int ret = -1;
+
+	/* get a file descriptor for the auth file */
+	int auth_fd = open(path, O_RDONLY);
+	if(auth_fd < 0) {
+		tab_error("could not open auth file '%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	char *auth_str = NULL;
+	char auth_buf[BUF_SIZE];
+	int auth_len = 0, auth_dlen;
+
+	/* read all file data -- in buffered chunks -- from the auth file (preserving null bytes) */
+	while((auth_dlen = read(auth_fd, auth_buf, BUF_SIZE)) > 0) {
+		auth_str = realloc(auth_str, auth_len + auth_dlen);
+		memcpy(auth_str + auth_len, auth_buf, auth_dlen);
+		auth_len += auth_dlen;
+	}
+
+	if(auth_dlen < 0) {
+		tab_error("could not read auth file '%s': %s", path, strerror(errno));
+		goto out;
+	}
+
+	/* split into username and password */
+	char *username = NULL, *password = NULL;
+	if(parse_auth(auth_str, auth_len, &username, &password) < 0) {
+		tab_error("invalid authentication specfication: no NULL separator");
+		goto out;
+	}
+
+	ret = tab_opt_set_auth(opt, username, password);
+
+	free(username);
+	free(password);
+
+out:
+	/* clean up */
+	free(auth_str);
+	close(auth_fd);
+	return ret;
+}
+
+int tab_opt_set_tls(struct tab_opt *opt, const char *ca_file) {
+	/* make sure we can actually do it */
+	if(!tls_available()) {
+		tab_error("built without TLS support");
+		return -1;
+	}
+
+	/* every connection made with opt shares the context, so the CAs are only loaded once */
+	struct tab_tls_ctx *ctx = tls_ctx_new(ca_file);
+	if(!ctx)
+		return -1;
+
+	tls_ctx_free(opt->tls_ctx);
+	opt->tls_ctx = ctx;
+	return 0;
+}
+
+int tab_opt_set_routes(struct tab_opt *opt, const char *path) {
+	return route_table_load(&opt->routes, path);
+}
+
+int tab_opt_set_trace(struct tab_opt *opt, const char *path) {
+	free(opt->trace_path);
+	opt->trace_path = strdup(path);
+	return 0;
+}
+
+int tab_opt_set_drain_timeout(struct tab_opt *opt, int seconds) {
+	/* make sure the timeout is sane */
+	if(seconds < 0) {
+		tab_error("invalid drain timeout: must not be negative");
+		return -1;
+	}
+
+	opt->drain_timeout = seconds;
+	return 0;
+}
+
+int tab_opt_check(struct tab_opt *opt) {
+	/* make sure a proxy hostname has been given (routing rules may make it unnecessary) */
+	if(!opt->proxy_hostname && !opt->routes.cidr && !opt->routes.domains) {
+		tab_error("missing proxy specification");
+		return -1;
+	}
+
+	/* make sure a dest hostname has been given */
+	if(!opt->dest_hostname) {
+		tab_error("missing dest specification");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void tab_conn_init(struct tab_conn *conn) {
+	memset(conn, 0, sizeof(struct tab_conn));
+	conn->fd = -1;
+	trace_init(&conn->trace);
+	conn->state = STATE_INIT;
+}
+
+struct tab_conn *tab_conn_new(void) {
+	struct tab_conn *conn = malloc(sizeof(struct tab_conn));
+	if(!conn) {
+		tab_error("could not allocate connection: %s", strerror(errno));
+		return NULL;
+	}
+
+	tab_conn_init(conn);
+	return conn;
+}
+
+void tab_conn_close(struct tab_conn *conn) {
+	tls_free(conn->tls);
+	if(conn->fd >= 0)
+		close(conn->fd);
+
+	free(conn->request);
+	tab_conn_init(conn);
+}
+
+void tab_conn_free(struct tab_conn *conn) {
+	if(!conn)
+		return;
+
+	tab_conn_close(conn);
+	free(conn);
+}
+
+int tab_conn_fd(struct tab_conn *conn) {
+	return conn->fd;
+}
+
+int tab_conn_tls(struct tab_conn *conn) {
+	return conn->tls != NULL;
+}
+
+static int set_nonblocking(int fd, int nonblocking) {
+	int flags = fcntl(fd, F_GETFL);
+	if(flags < 0)
+		return -1;
+
+	if(nonblocking)
+		flags |= O_NONBLOCK;
+	else
+		flags &= ~O_NONBLOCK;
+
+	return fcntl(fd, F_SETFL, flags);
+}
+
+/* resolves the hostname (unless that's already been done) and starts connecting to it, without waiting for the connection */
+static int sock_connect(struct tab_trace *trace, char *hostname, struct in_addr *resolved, int port) {
+	struct sockaddr_in addr;
+
+	/* create stream socket */
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0 || set_nonblocking(fd, 1) < 0) {
+		tab_error("could not create socket: %s", strerror(errno));
+		if(fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	/* resolve (which also takes care of address literals) */
+	if(resolved) {
+		addr.sin_addr = *resolved;
+	} else if(resolve_ipv4(hostname, &addr.sin_addr) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	TRACE_STAMP(trace, TRACE_RESOLVED);
+
+	/* fill in other addr data */
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	/* actually connect stream to host */
+	if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) && errno != EINPROGRESS) {
+		tab_error("could not connect to '%s:%d': %s", hostname, port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* read(2), recv(2) with MSG_PEEK and write(2) on the tunnel, through TLS if it is being used. writes
+ * never raise SIGPIPE (a tunnel which has gone away is just EPIPE). */
+ssize_t tab_read(struct tab_conn *conn, void *buf, size_t len) {
+	if(conn->tls)
+		return tls_read(conn->tls, buf, len);
+	return read(conn->fd, buf, len);
+}
+
+static ssize_t tab_peek(struct tab_conn *conn, void *buf, size_t len) {
+	if(conn->tls)
+		return tls_peek(conn->tls, buf, len);
+	return recv(conn->fd, buf, len, MSG_PEEK);
+}
+
+ssize_t tab_write(struct tab_conn *conn, const void *buf, size_t len) {
+	if(conn->tls)
+		return tls_write(conn->tls, buf, len);
+	return send(conn->fd, buf, len, MSG_NOSIGNAL);
+}
+
+static char *generate_proxy_request(struct tab_opt *opt) {
+	char *request_str = NULL;
+	int request_len = 0;
+
+	/* set up CONNECT request */
+	int conn_len = LENPRINTF(PROXY_CONNECT_FORMAT, opt->dest_hostname, opt->dest_port);
+	char *conn_str = malloc(conn_len + 1);
+	snprintf(conn_str, conn_len + 1, PROXY_CONNECT_FORMAT, opt->dest_hostname, opt->dest_port);
+	conn_str[conn_len] = '\0';
+
+	/* append CONNECT to request */
+	request_str = realloc(request_str, request_len + conn_len + 1);
+	strncpy(request_str, conn_str, conn_len);
+	request_len += conn_len;
+	request_str[request_len] = '\0';
+
+	/* set up Proxy-Authorization if needed */
+	switch(opt->proxy_auth) {
+		case AUTH_NONE:
+			break;
+		case AUTH_BASIC:
+			{
+				/* create basic "user:pass" spec */
+				int auth_plain_len = LENPRINTF("%s:%s", opt->auth_username, opt->auth_password);
+				char *auth_plain = malloc(auth_plain_len + 1);
+				snprintf(auth_plain, auth_plain_len + 1, "%s:%s", opt->auth_username, opt->auth_password);
+				auth_plain[auth_plain_len] = '\0';
+
+				/* encode base64 digest for authentication */
+				int auth_digest_len = LENTOBASE64(auth_plain_len), off = 0;
+				char *auth_digest = malloc(auth_digest_len + 1);;
+				base64_encodestate enc_state;
+				base64_init_encodestate(&enc_state);
+				off += base64_encode_block(auth_plain, auth_plain_len, auth_digest, &enc_state);
+				off += base64_encode_blockend(auth_digest + off, &enc_state);
+				auth_digest[off] = '\0';
+
+				_debug("generated HTTP basic authentication digest '%s'\n", auth_digest);
+
+				/* set up auth */
+				int auth_len = LENPRINTF(PROXY_BASIC_AUTH_FORMAT, auth_digest);
+				char *auth_str = malloc(auth_len + 1);
+				snprintf(auth_str, auth_len + 1, PROXY_BASIC_AUTH_FORMAT, auth_digest);
+				auth_str[auth_len] = '\0';
+
+				/* append auth to request */
+				request_str = realloc(request_str, request_len + auth_len + 1);
+				strncat(request_str, auth_str, auth_len);
+				request_len += auth_len;
+
+				/* free memory */
+				free(auth_plain);
+				free(auth_digest);
+				free(auth_str);
+			}
+			break;
+	}
+
+	/* append terminating CRLF */
+	request_str = realloc(request_str, request_len + strlen(CRLF) + 1);
+	strncat(request_str, CRLF, strlen(CRLF));
+	request_len += strlen(CRLF);
+
+	/* free memory */
+	free(conn_str);
+
+	/* request generated */
+	_debug("generated proxy request\n");
+	return request_str;
+}
+
+/* reads the proxy's response, without reading past the end of its headers -- anything after
+ * them belongs to the tunnel, and is left in the socket for whoever uses it */
+static int read_response(struct tab_conn *conn) {
+	char peek[TAB_RESPONSE_MAX];
+	int space = TAB_RESPONSE_MAX - 1 - conn->response_len;
+
+	if(space <= 0) {
+		tab_error("proxy response too long");
+		return -1;
+	}
+
+	ssize_t len = tab_peek(conn, peek, space);
+	if(len < 0) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+			return TAB_WANT_READ;
+
+		tab_error("could not read proxy response: %s", strerror(errno));
+		return -1;
+	}
+
+	if(len == 0) {
+		tab_error("proxy closed the connection without responding");
+		return -1;
+	}
+
+	/* only consume up to the end of the headers (if they've ended) */
+	memcpy(conn->response + conn->response_len, peek, len);
+	int end = parse_response_end(conn->response, conn->response_len + len, conn->response_len);
+	if(end >= 0)
+		len = end - conn->response_len;
+
+	len = tab_read(conn, conn->response + conn->response_len, len);
+	if(len <= 0) {
+		tab_error("could not read proxy response: %s", strerror(errno));
+		return -1;
+	}
+
+	conn->response_len += len;
+	conn->response[conn->response_len] = '\0';
+
+	return end >= 0 ? TAB_DONE : TAB_WANT_READ;
+}
+
+static int check_response(struct tab_conn *conn) {
+	/* parse the response. it should be of the form "HTTP/[x.y] [code] [description]". */
+	struct proxy_response resp;
+	if(parse_proxy_response(conn->response, &resp) < 0) {
+		tab_error("error parsing proxy reponse");
+		return -1;
+	}
+
+	_debug("parsed proxy response: %d (%s)\n", resp.code, resp.description);
+
+	/* deal with error codes */
+	if(resp.code < 200 || resp.code >= 300) {
+		tab_error("error negotiating with proxy: %s", resp.description);
+		return -1;
+	}
+
+	/* deal with invalid HTTP version */
+	if(resp.maj < 1) {
+		tab_error("invalid HTTP protocol version returned by proxy: %d.%d", resp.maj, resp.min);
+		return -1;
+	}
+
+	return 0;
+}
+
+int tab_connect_start(struct tab_opt *opt, struct tab_conn *conn) {
+	/* start again from scratch, if conn has been used before */
+	tab_conn_close(conn);
+
+	/* every connection gets its own trace, so one tab_opt can be used for many of them */
+	conn->trace.enabled = opt->trace_path != NULL;
+	TRACE_STAMP(&conn->trace, TRACE_START);
+
+	if(!opt->dest_hostname) {
+		tab_error("missing dest specification");
+		return -1;
+	}
+
+	/* by default, everything goes through the proxy */
+	conn->direct = 0;
+	conn->via_hostname = opt->proxy_hostname;
+	conn->via_port = opt->proxy_port;
+
+	/* figure out how to reach the destination */
+	struct in_addr dest_addr;
+	int dest_resolve = 0, dest_resolved = 0;
+	struct route *route = route_lookup(&opt->routes, opt->dest_hostname, &dest_resolve);
+
+	/* network rules need the destination's address, which a direct connection can then reuse. the
+	 * resolution is traced as such (rather than as part of routing), even though it comes first. */
+	if(dest_resolve && !resolve_ipv4(opt->dest_hostname, &dest_addr)) {
+		dest_resolved = 1;
+		TRACE_STAMP(&conn->trace, TRACE_RESOLVED);
+		route = route_lookup_addr(&opt->routes, &dest_addr);
+	}
+
+	TRACE_STAMP(&conn->trace, TRACE_ROUTED);
+	if(route) {
+		switch(route->action) {
+			case ROUTE_DIRECT:
+				conn->direct = 1;
+				conn->via_hostname = opt->dest_hostname;
+				conn->via_port = opt->dest_port;
+				break;
+			case ROUTE_PROXY:
+				conn->via_hostname = route->proxy_hostname;
+				conn->via_port = route->proxy_port;
+				break;
+		}
+	}
+
+	if(!conn->via_hostname) {
+		tab_error("no route to dest '%s' and no default proxy given", opt->dest_hostname);
+		return -1;
+	}
+
+	_debug("routing decision for '%s:%d': %s '%s:%d'\n", opt->dest_hostname, opt->dest_port, conn->direct ? "direct to" : "proxy via", conn->via_hostname, conn->via_port);
+
+	/* connect to the proxy (or the destination itself) */
+	conn->fd = sock_connect(&conn->trace, conn->via_hostname, conn->direct && dest_resolved ? &dest_addr : NULL, conn->via_port);
+	if(conn->fd < 0)
+		return -1;
+
+	conn->state = STATE_CONNECTING;
+	return tab_connect_continue(opt, conn);
+}
+
+int tab_connect_continue(struct tab_opt *opt, struct tab_conn *conn) {
+	while(1) {
+		switch(conn->state) {
+			case STATE_CONNECTING:
+				{
+					/* make sure the connection has actually finished */
+					struct pollfd pfd = { conn->fd, POLLOUT, 0 };
+					if(poll(&pfd, 1, 0) == 0)
+						return TAB_WANT_WRITE;
+
+					int err = 0;
+					socklen_t err_len = sizeof(err);
+					if(getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0)
+						err = errno;
+
+					if(err) {
+						tab_error("could not connect to '%s:%d': %s", conn->via_hostname, conn->via_port, strerror(err));
+						return -1;
+					}
+
+					TRACE_STAMP(&conn->trace, TRACE_CONNECTED);
+					_debug("connected to '%s:%d'\n", conn->via_hostname, conn->via_port);
+
+					/* direct connections need no negotiation */
+					if(conn->direct) {
+						conn->state = STATE_DONE;
+						break;
+					}
+
+					/* encrypt everything sent to the proxy (including the credentials) */
+					if(opt->tls_ctx) {
+						conn->tls = tls_start(opt->tls_ctx, conn->fd, conn->via_hostname);
+						if(!conn->tls)
+							return -1;
+
+						conn->state = STATE_TLS_HANDSHAKE;
+						break;
+					}
+
+					conn->state = STATE_REQUEST;
+				}
+				break;
+			case STATE_TLS_HANDSHAKE:
+				{
+					int ret = tls_handshake(conn->tls);
+					if(ret != TAB_DONE)
+						return ret;
+
+					TRACE_STAMP(&conn->trace, TRACE_HANDSHAKE);
+					conn->trace.ktls = tls_ktls(conn->tls);
+					conn->state = STATE_REQUEST;
+				}
+				break;
+			case STATE_REQUEST:
+				{
+					if(!conn->request) {
+						conn->request = generate_proxy_request(opt);
+						conn->request_len = strlen(conn->request);
+						conn->request_off = 0;
+					}
+
+					/* send as much of the request as we can */
+					while(conn->request_off < conn->request_len) {
+						ssize_t len = tab_write(conn, conn->request + conn->request_off, conn->request_len - conn->request_off);
+						if(len < 0) {
+							if(errno == EAGAIN || errno == EWOULDBLOCK)
+								return TAB_WANT_WRITE;
+
+							tab_error("could not negotiate stream with proxy: %s", strerror(errno));
+							return -1;
+						}
+
+						conn->request_off += len;
+					}
+
+					free(conn->request);
+					conn->request = NULL;
+
+					TRACE_STAMP(&conn->trace, TRACE_REQUEST_SENT);
+					_debug("sent request to proxy\n");
+					conn->state = STATE_RESPONSE;
+				}
+				break;
+			case STATE_RESPONSE:
+				{
+					int ret = read_response(conn);
+					if(ret != TAB_DONE)
+						return ret;
+
+					TRACE_STAMP(&conn->trace, TRACE_RESPONSE);
+					_debug("received response from proxy\n");
+
+					if(check_response(conn) < 0)
+						return -1;
+
+					conn->state = STATE_DONE;
+				}
+				break;
+			case STATE_DONE:
+				return TAB_DONE;
+			default:
+				tab_error("connection not started");
+				return -1;
+		}
+	}
+}
+
+static long monotonic_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+int tab_connect(struct tab_opt *opt, struct tab_conn *conn) {
+	int ret = tab_connect_start(opt, conn);
+
+	while(ret == TAB_WANT_READ || ret == TAB_WANT_WRITE) {
+		struct pollfd pfd = { conn->fd, ret == TAB_WANT_READ ? POLLIN : POLLOUT, 0 };
+
+		/* like connect(2), connecting has no timeout of its own -- the rest of the handshake does */
+		int timeout = conn->state == STATE_CONNECTING ? -1 : HANDSHAKE_TIMEOUT * 1000;
+		long deadline = monotonic_ms() + timeout;
+
+		/* a signal (with a handler that doesn't restart system calls) isn't a reason to give up */
+		int n;
+		while((n = poll(&pfd, 1, timeout)) < 0 && errno == EINTR) {
+			if(timeout < 0)
+				continue;
+
+			long remaining = deadline - monotonic_ms();
+			timeout = remaining > 0 ? remaining : 0;
+		}
+
+		if(n < 0) {
+			tab_error("could not set up tunnel: %s", strerror(errno));
+			return -1;
+		}
+
+		if(n == 0) {
+			tab_error("timed out negotiating with proxy");
+			return -1;
+		}
+
+		ret = tab_connect_continue(opt, conn);
+	}
+
+	if(ret < 0)
+		return -1;
+
+	/* hand back an ordinary blocking socket */
+	if(set_nonblocking(conn->fd, 0) < 0) {
+		tab_error("could not set up tunnel: %s", strerror(errno));
+		return -1;
+	}
+
+	return conn->fd;
+}
+
+/* data read from one side of the relay, waiting to be written to the other */
+struct relay_buf {
+	char data[BUF_SIZE];
+	size_t off;
+	size_t len;
+};
+
+/* writes as much of buf as fd (or the tunnel, if conn is given) will take without blocking.
+ * returns -1 if the write failed, and 0 otherwise -- including when it has to wait for room (either
+ * side may be non-blocking, like a tunnel set up with tab_connect_start()) or was interrupted by a
+ * shutdown signal (which doesn't restart system calls). */
+static int relay_write(struct tab_conn *conn, int fd, struct relay_buf *buf) {
+	ssize_t n = conn ? tab_write(conn, buf->data + buf->off, buf->len) : write(fd, buf->data + buf->off, buf->len);
+
+	if(n < 0)
+		return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+	/* TLS has to be retried with the same data, which is the case until all of it has gone */
+	buf->off += n;
+	buf->len -= n;
+	if(!buf->len)
+		buf->off = 0;
+
+	return 0;
+}
+
+int tab_relay(struct tab_opt *opt, struct tab_conn *conn, int in_fd, int out_fd, volatile sig_atomic_t *drain) {
+	/* up is from in_fd to the tunnel, down is from the tunnel to out_fd */
+	struct relay_buf up = { .off = 0, .len = 0 }, down = { .off = 0, .len = 0 };
+	struct pollfd fds[3];
+	ssize_t len;
+
+	int draining = 0, shut = 0, in_done = 0;
+	long deadline = 0;
+
+	/* main relay loop. each side is only read once what was last read from it has been passed on,
+	 * but waiting to write one way never stops data coming the other way (which could deadlock with
+	 * a peer doing the same). */
+	_debug("starting main relay loop\n");
+	while(1) {
+		/* a second signal means we shouldn't wait any longer */
+		if(drain && *drain > 1) {
+			_debug("forced shutdown, abandoning relay\n");
+			break;
+		}
+
+		/* in_fd has closed, and everything from the tunnel has been passed on */
+		if(in_done && !down.len)
+			break;
+
+		/* start draining -- in_fd is left alone from now on */
+		if(drain && *drain && !draining) {
+			_debug("draining relay (for up to %ds)\n", opt->drain_timeout);
+			draining = 1;
+			deadline = monotonic_ms() + opt->drain_timeout * 1000L;
+		}
+
+		/* the other end sees EOF (once it has everything read before the signal), but can still respond */
+		if(draining && !shut && !up.len) {
+			shut = 1;
+			if(conn->tls)
+				tls_shutdown(conn->tls);
+			shutdown(conn->fd, SHUT_WR);
+		}
+
+		/* set timeout (in milliseconds) */
+		int timeout = 5000;
+
+		if(draining) {
+			long remaining = deadline - monotonic_ms();
+			if(remaining <= 0) {
+				_debug("drain deadline passed, abandoning relay\n");
+				break;
+			}
+
+			if(remaining < timeout)
+				timeout = remaining;
+		}
+
+		/* TLS may have already read (and decrypted) data that poll() can't see */
+		int pending = !down.len && conn->tls && tls_pending(conn->tls) > 0;
+		if(pending)
+			timeout = 0;
+
+		/* poll() ignores negative fds, which is how anything with nothing to do is left out */
+		fds[0].events = (down.len ? 0 : POLLIN) | (up.len ? POLLOUT : 0);
+		fds[0].fd = fds[0].events ? conn->fd : -1;
+		fds[0].revents = 0;
+		fds[1].fd = draining || in_done || up.len ? -1 : in_fd;
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+		fds[2].fd = down.len ? out_fd : -1;
+		fds[2].events = POLLOUT;
+		fds[2].revents = 0;
+
+		if(poll(fds, 3, timeout) < 0) {
+			/* a signal arrived, deal with it at the top of the loop */
+			if(errno == EINTR)
+				continue;
+
+			tab_error("could not wait for data: %s", strerror(errno));
+			return -1;
+		}
+
+		/* is there any data ready to read from the socket? */
+		if(!down.len && (pending || fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+			len = tab_read(conn, down.data, BUF_SIZE);
+			if(len < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+				tab_error("could not read from tunnel: %s", strerror(errno));
+				return -1;
+			}
+			if(!len)
+				break;
+
+			if(len > 0) {
+				TRACE_STAMP(&conn->trace, TRACE_FIRST_DOWN);
+				TRACE_BYTES(&conn->trace, bytes_down, len);
+
+				/* there's usually room, so don't wait for poll() to say so */
+				down.len = len;
+				if(relay_write(NULL, out_fd, &down) < 0)
+					goto write_error;
+			}
+		}
+
+		/* is there any data ready to read from in_fd? */
+		if(fds[1].revents) {
+			len = read(in_fd, up.data, BUF_SIZE);
+			if(len < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+				tab_error("could not read data to relay: %s", strerror(errno));
+				return -1;
+			}
+			if(!len)
+				in_done = 1;
+
+			if(len > 0) {
+				TRACE_STAMP(&conn->trace, TRACE_FIRST_UP);
+				TRACE_BYTES(&conn->trace, bytes_up, len);
+
+				up.len = len;
+				if(relay_write(conn, -1, &up) < 0)
+					goto tunnel_error;
+			}
+		}
+
+		/* pass on the rest of anything that didn't fit last time, now there's room */
+		if(fds[0].events & POLLOUT && fds[0].revents & (POLLOUT | POLLERR | POLLHUP) && relay_write(conn, -1, &up) < 0)
+			goto tunnel_error;
+		if(fds[2].fd >= 0 && fds[2].revents && relay_write(NULL, out_fd, &down) < 0)
+			goto write_error;
+	}
+
+	_debug("connection closed\n");
+	return 0;
+
+tunnel_error:
+	tab_error("could not write to tunnel: %s", strerror(errno));
+	return -1;
+
+write_error:
+	tab_error("could not write relayed data: %s", strerror(errno));
+	return -1;
+}
+
+int tab_conn_trace(struct tab_opt *opt, struct tab_conn *conn, int status) {
+	char dest[BUF_SIZE], via[BUF_SIZE] = "none";
+
+	if(!opt->trace_path)
+		return 0;
+
+	if(opt->dest_hostname)
+		snprintf(dest, BUF_SIZE, "%s:%d", opt->dest_hostname, opt->dest_port);
+	else
+		snprintf(dest, BUF_SIZE, "none");
+	if(conn->via_hostname)
+		snprintf(via, BUF_SIZE, "%s:%s:%d", conn->direct ? "direct" : "proxy", conn->via_hostname, conn->via_port);
+
+	return trace_write(&conn->trace, opt->trace_path, dest, via, status);
+}
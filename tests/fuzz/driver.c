@@ -0,0 +1,68 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* standalone driver for the fuzz targets, for building them without libFuzzer (with AFL, or just
+ * to replay a corpus). each argument is an input file -- with no arguments, stdin is used. */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int run_file(FILE *input) {
+	uint8_t *data = NULL;
+	size_t size = 0, len;
+	uint8_t buf[4096];
+
+	while((len = fread(buf, 1, sizeof(buf), input)) > 0) {
+		data = realloc(data, size + len);
+		memcpy(data + size, buf, len);
+		size += len;
+	}
+
+	if(ferror(input)) {
+		free(data);
+		return -1;
+	}
+
+	LLVMFuzzerTestOneInput(data, size);
+	free(data);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int i;
+
+	if(argc < 2)
+		return run_file(stdin) < 0;
+
+	for(i = 1; i < argc; i++) {
+		FILE *input = fopen(argv[i], "rb");
+		if(!input || run_file(input) < 0) {
+			perror(argv[i]);
+			return 1;
+		}
+		fclose(input);
+	}
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fuzz target for parse_auth() (the contents of the -a auth file). */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	/* copy so that reads past the end are caught */
+	char *auth_str = malloc(size ? size : 1);
+	memcpy(auth_str, data, size);
+
+	char *username = NULL, *password = NULL;
+	if(!parse_auth(auth_str, size, &username, &password)) {
+		if(strlen(username) + 1 + strlen(password) > size)
+			abort();
+	}
+
+	free(username);
+	free(password);
+	free(auth_str);
+	return 0;
+}
@@ -0,0 +1,58 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fuzz target for libb64: decoding arbitrary input, and round-tripping it through the encoder. */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "b64/cencode.h"
+#include "b64/cdecode.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	/* decoding never produces more than 3 bytes per 4 characters */
+	char *plain = malloc(size + 1);
+	base64_decodestate dec_state;
+	base64_init_decodestate(&dec_state);
+	base64_decode_block((const char *) data, size, plain, &dec_state);
+
+	/* encoding must fit in LENTOBASE64() (which is what generate_proxy_request() allocates) */
+	int code_len = LENTOBASE64(size);
+	char *code = malloc(code_len + 1);
+	base64_encodestate enc_state;
+	base64_init_encodestate(&enc_state);
+	int off = base64_encode_block((const char *) data, size, code, &enc_state);
+	off += base64_encode_blockend(code + off, &enc_state);
+	if(off != code_len)
+		abort();
+
+	/* and decoding that must give back the input */
+	char *decoded = malloc(size + 1);
+	base64_init_decodestate(&dec_state);
+	int decoded_len = base64_decode_block(code, off, decoded, &dec_state);
+	if(decoded_len < 0 || (size_t) decoded_len != size || memcmp(decoded, data, size))
+		abort();
+
+	free(plain);
+	free(code);
+	free(decoded);
+	return 0;
+}
@@ -0,0 +1,77 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fuzz target for parse_response_end(), fed the way read_response() feeds it: the response arrives
+ * in pieces (of a size taken from the first byte), and only what belongs to it is consumed. */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulltab/parse.h"
+
+/* the headers end at the first blank line, found in one go */
+static int reference_end(const uint8_t *data, int size) {
+	int i;
+
+	for(i = 2; i <= size; i++) {
+		if(!memcmp(data + i - 2, "\n\n", 2))
+			return i;
+		if(i >= 4 && !memcmp(data + i - 4, "\r\n\r\n", 4))
+			return i;
+	}
+
+	return -1;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if(size < 1)
+		return 0;
+
+	int step = 1 + data[0] % 64;
+	data++;
+	size--;
+
+	char *buf = malloc(size + 1);
+	int have = 0, end = -1;
+
+	while(end < 0 && have < (int) size) {
+		/* peek at the next piece, but only consume the part of it before the end of the headers */
+		int len = size - have < (size_t) step ? (int) (size - have) : step;
+		memcpy(buf + have, data + have, len);
+
+		end = parse_response_end(buf, have + len, have);
+		if(end >= 0) {
+			if(end <= have || end > have + len)
+				abort();
+			len = end - have;
+		}
+
+		have += len;
+	}
+
+	if(end != reference_end(data, size))
+		abort();
+	if(end >= 0 && have != end)
+		abort();
+
+	free(buf);
+	return 0;
+}
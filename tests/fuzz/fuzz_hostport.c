@@ -0,0 +1,46 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fuzz target for parse_hostport() (the -x and -d specs, and proxies in route files). */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	/* specs come from argv, so they are always NULL-terminated */
+	char *spec = malloc(size + 1);
+	memcpy(spec, data, size);
+	spec[size] = '\0';
+
+	char *hostname = NULL;
+	int port = 0;
+	if(!parse_hostport(spec, DEFAULT_PROXY_PORT, &hostname, &port)) {
+		if(port < PORT_LOWER_LIM || port > PORT_UPPER_LIM || strlen(hostname) > size)
+			abort();
+	}
+
+	free(hostname);
+	free(spec);
+	return 0;
+}
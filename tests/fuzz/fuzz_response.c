@@ -0,0 +1,47 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* fuzz target for parse_proxy_response() (the proxy's reply to CONNECT). */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	char buf[BUF_SIZE];
+	struct proxy_response resp;
+
+	/* read_response() keeps at most TAB_RESPONSE_MAX - 1 (BUF_SIZE - 1) bytes, NULL-terminated */
+	if(size > BUF_SIZE - 1)
+		size = BUF_SIZE - 1;
+
+	memset(buf, 0, BUF_SIZE);
+	memcpy(buf, data, size);
+
+	if(!parse_proxy_response(buf, &resp)) {
+		if(strlen(resp.description) >= BUF_SIZE)
+			abort();
+	}
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* makes sure pulltab.h can be used from C++: it has to compile without warnings (string literals
+ * being const, for one) and link against the C library. */
+
+#include <cstdio>
+#include <cstring>
+
+#include "pulltab/pulltab.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if(!(cond)) { \
+			fprintf(stderr, "FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			failures++; \
+		} \
+	} while(0)
+
+int main(void) {
+	struct tab_opt *opt = tab_opt_new();
+	struct tab_conn *conn = tab_conn_new();
+
+	CHECK(!tab_opt_set_proxy(opt, "proxy.example.com:3128"), "%s", tab_strerror());
+	CHECK(!tab_opt_set_dest(opt, "example.com:22"), "%s", tab_strerror());
+	CHECK(!tab_opt_set_auth(opt, "user", "pass"), "%s", tab_strerror());
+	CHECK(!tab_opt_set_trace(opt, "/dev/null"), "%s", tab_strerror());
+	CHECK(!tab_opt_set_drain_timeout(opt, TAB_DEFAULT_DRAIN_TIMEOUT), "%s", tab_strerror());
+	CHECK(!tab_opt_check(opt), "%s", tab_strerror());
+
+	CHECK(tab_opt_set_routes(opt, "/nonexistent/routes") < 0, "missing route file accepted");
+	CHECK(strstr(tab_strerror(), "/nonexistent/routes"), "unexpected error '%s'", tab_strerror());
+
+	CHECK(tab_conn_fd(conn) < 0 && !tab_conn_tls(conn), "new connection isn't empty");
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+
+	if(failures) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("C++ API check passed\n");
+	return 0;
+}
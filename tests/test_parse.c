@@ -0,0 +1,408 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* deterministic property tests for the option, route file and handshake parsers (and libb64). every
+ * run uses the same seed, so failures are reproducible -- pass a seed as the first argument to explore. */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include "b64/cencode.h"
+#include "b64/cdecode.h"
+#include "pulltab/common.h"
+#include "pulltab/parse.h"
+#include "pulltab/pulltab.h"
+#include "pulltab/route.h"
+
+#define ITERATIONS 10000
+#define MAX_FIELD  64
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if(!(cond)) { \
+			fprintf(stderr, "FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			failures++; \
+		} \
+	} while(0)
+
+/* xorshift, so runs don't depend on the libc's rand() */
+static unsigned long rng_state = 0x5eed;
+
+static unsigned long rng(void) {
+	rng_state ^= (rng_state << 13) & 0xffffffffUL;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= (rng_state << 5) & 0xffffffffUL;
+	return rng_state;
+}
+
+/* fills buf with len random bytes from charset (or any byte, if charset is NULL) */
+static void rng_fill(char *buf, int len, char *charset) {
+	int i, n = charset ? strlen(charset) : 256;
+
+	for(i = 0; i < len; i++)
+		buf[i] = charset ? charset[rng() % n] : (char) (rng() % n);
+}
+
+#define HOST_CHARSET "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-_[]"
+#define TEXT_CHARSET "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!?-()"
+
+static void test_hostport(void) {
+	char host[MAX_FIELD + 1], spec[2 * MAX_FIELD];
+	int i;
+
+	for(i = 0; i < ITERATIONS; i++) {
+		int hlen = rng() % MAX_FIELD;
+		rng_fill(host, hlen, HOST_CHARSET);
+		host[hlen] = '\0';
+
+		/* anything from "no port" to out of range in both directions */
+		int port = (int) (rng() % (PORT_UPPER_LIM + 10)) - 5;
+		int has_port = rng() % 4;
+		int default_port = PORT_LOWER_LIM + rng() % PORT_UPPER_LIM;
+
+		if(has_port)
+			snprintf(spec, sizeof(spec), "%s:%d", host, port);
+		else
+			snprintf(spec, sizeof(spec), "%s", host);
+
+		char *hostname = NULL;
+		int parsed_port = 0;
+		int ret = parse_hostport(spec, default_port, &hostname, &parsed_port);
+
+		int expected_port = has_port ? port : default_port;
+		int valid = expected_port >= PORT_LOWER_LIM && expected_port <= PORT_UPPER_LIM;
+
+		CHECK(ret == (valid ? 0 : -1), "spec '%s' returned %d", spec, ret);
+		if(valid) {
+			CHECK(!strcmp(hostname, host), "spec '%s' gave host '%s'", spec, hostname);
+			CHECK(parsed_port == expected_port, "spec '%s' gave port %d", spec, parsed_port);
+		} else {
+			CHECK(!hostname, "spec '%s' allocated a hostname on failure", spec);
+		}
+
+		free(hostname);
+	}
+
+	/* the host ends at the first separator (so IPv6 literals aren't supported) */
+	char *hostname = NULL;
+	int port = 0;
+	CHECK(!parse_hostport("a:80:90", 1, &hostname, &port), "a:80:90 rejected");
+	CHECK(hostname && !strcmp(hostname, "a") && port == 80, "a:80:90 gave '%s' %d", hostname, port);
+	free(hostname);
+}
+
+static void test_auth(void) {
+	char user[MAX_FIELD + 1], pass[MAX_FIELD + 1], auth[2 * MAX_FIELD + 1];
+	int i;
+
+	for(i = 0; i < ITERATIONS; i++) {
+		int ulen = rng() % MAX_FIELD;
+		int plen = rng() % MAX_FIELD;
+		int has_sep = rng() % 8;
+
+		/* no NULL bytes in either field, so the separator is the only one */
+		rng_fill(user, ulen, TEXT_CHARSET ":");
+		rng_fill(pass, plen, TEXT_CHARSET ":");
+		user[ulen] = pass[plen] = '\0';
+
+		int auth_len = ulen;
+		memcpy(auth, user, ulen);
+		if(has_sep) {
+			auth[auth_len++] = '\0';
+			memcpy(auth + auth_len, pass, plen);
+			auth_len += plen;
+		}
+
+		char *username = NULL, *password = NULL;
+		int ret = parse_auth(auth, auth_len, &username, &password);
+
+		CHECK(ret == (has_sep ? 0 : -1), "auth '%s' returned %d", user, ret);
+		if(has_sep) {
+			CHECK(!strcmp(username, user), "username '%s' != '%s'", username, user);
+			CHECK(!strcmp(password, pass), "password '%s' != '%s'", password, pass);
+		} else {
+			CHECK(!username && !password, "auth '%s' allocated fields on failure", user);
+		}
+
+		free(username);
+		free(password);
+	}
+
+	/* an empty auth file has no separator */
+	char *username = NULL, *password = NULL;
+	CHECK(parse_auth(NULL, 0, &username, &password) < 0, "empty auth accepted");
+}
+
+static void test_proxy_response(void) {
+	char desc[MAX_FIELD + 1], buf[BUF_SIZE];
+	struct proxy_response resp;
+	int i;
+
+	for(i = 0; i < ITERATIONS; i++) {
+		int maj = rng() % 3, min = rng() % 10, code = 100 + rng() % 500;
+		int dlen = 1 + rng() % MAX_FIELD;
+
+		/* descriptions don't start with whitespace (it's skipped) */
+		rng_fill(desc, dlen, TEXT_CHARSET);
+		desc[0] = 'x';
+		desc[dlen] = '\0';
+
+		snprintf(buf, BUF_SIZE, "HTTP/%d.%d %d %s\nVia: 1.1 proxy\r\n\r\n", maj, min, code, desc);
+
+		CHECK(!parse_proxy_response(buf, &resp), "response '%s' rejected", buf);
+		CHECK(resp.maj == maj && resp.min == min && resp.code == code, "response '%s' gave %d.%d %d", buf, resp.maj, resp.min, resp.code);
+		CHECK(!strcmp(resp.description, desc), "response '%s' gave description '%s'", buf, resp.description);
+
+		/* any truncation before the description is rejected */
+		int cut = rng() % (strlen(buf) - strlen(desc) - strlen("\nVia: 1.1 proxy\r\n\r\n"));
+		buf[cut] = '\0';
+		CHECK(parse_proxy_response(buf, &resp) < 0, "truncated response '%s' accepted", buf);
+	}
+
+	/* arbitrary junk should never crash, or fill the description past its end */
+	for(i = 0; i < ITERATIONS; i++) {
+		int len = rng() % (BUF_SIZE - 1);
+		rng_fill(buf, len, NULL);
+		buf[len] = '\0';
+
+		if(!parse_proxy_response(buf, &resp))
+			CHECK(strlen(resp.description) < BUF_SIZE, "description overflowed");
+	}
+
+	CHECK(parse_proxy_response("HTTP/1.1 200\r\n", &resp) < 0, "response without description accepted");
+	CHECK(parse_proxy_response("HTTP/1.0 407 Proxy Authentication Required\r\n", &resp) == 0 && resp.code == 407, "407 rejected");
+}
+
+static void test_response_end(void) {
+	char data[2 * MAX_FIELD], buf[2 * MAX_FIELD];
+	int i, j;
+
+	for(i = 0; i < ITERATIONS; i++) {
+		/* mostly line endings, so there are plenty of near misses */
+		int len = rng() % sizeof(data);
+		rng_fill(data, len, "\r\n\r\n\r\nab");
+
+		/* where the headers end, found in one go */
+		int expected = -1;
+		for(j = 2; j <= len && expected < 0; j++)
+			if(!memcmp(data + j - 2, "\n\n", 2) || (j >= 4 && !memcmp(data + j - 4, "\r\n\r\n", 4)))
+				expected = j;
+
+		/* fed in random pieces (like read_response() peeking), only consuming up to the end */
+		int have = 0, end = -1;
+		while(end < 0 && have < len) {
+			int piece = 1 + rng() % (len - have);
+			memcpy(buf + have, data + have, piece);
+
+			end = parse_response_end(buf, have + piece, have);
+			if(end >= 0) {
+				CHECK(end > have && end <= have + piece, "end %d outside of the piece at %d (+%d)", end, have, piece);
+				piece = end - have;
+			}
+
+			have += piece;
+		}
+
+		CHECK(end == expected, "found the end at %d rather than %d", end, expected);
+		if(end >= 0)
+			CHECK(have == end, "consumed %d bytes of a %d byte response", have, end);
+	}
+
+	CHECK(parse_response_end("HTTP/1.1 200 OK\r\n\r\nSSH", 22, 0) == 19, "CRLFs not accepted");
+	CHECK(parse_response_end("HTTP/1.1 200 OK\n\nSSH", 20, 0) == 17, "bare newlines not accepted");
+	CHECK(parse_response_end("HTTP/1.1 200 OK\r\n\r", 18, 0) < 0, "ended before the last newline");
+}
+
+static void test_base64(void) {
+	char plain[BUF_SIZE], decoded[BUF_SIZE], code[LENTOBASE64(BUF_SIZE) + 1];
+	int i;
+
+	for(i = 0; i < ITERATIONS; i++) {
+		int len = rng() % 256;
+		rng_fill(plain, len, NULL);
+
+		/* one-shot encoding */
+		base64_encodestate enc_state;
+		base64_init_encodestate(&enc_state);
+		int clen = base64_encode_block(plain, len, code, &enc_state);
+		clen += base64_encode_blockend(code + clen, &enc_state);
+
+		CHECK(clen == LENTOBASE64(len), "encoding %d bytes gave %d chars (expected %d)", len, clen, LENTOBASE64(len));
+
+		/* encoding in arbitrary chunks must give the same result */
+		char chunked[LENTOBASE64(BUF_SIZE) + 1];
+		int off = 0, pos = 0;
+		base64_init_encodestate(&enc_state);
+		while(pos < len) {
+			int chunk = 1 + rng() % (len - pos);
+			off += base64_encode_block(plain + pos, chunk, chunked + off, &enc_state);
+			pos += chunk;
+		}
+		off += base64_encode_blockend(chunked + off, &enc_state);
+
+		CHECK(off == clen && !memcmp(code, chunked, clen), "chunked encoding of %d bytes differs", len);
+
+		/* and decoding it gives back the original */
+		base64_decodestate dec_state;
+		base64_init_decodestate(&dec_state);
+		int dlen = base64_decode_block(code, clen, decoded, &dec_state);
+
+		CHECK(dlen == len && !memcmp(plain, decoded, len), "round trip of %d bytes gave %d bytes", len, dlen);
+	}
+
+	/* every byte value is either in the alphabet or ignored */
+	for(i = 0; i < 256; i++) {
+		int value = base64_decode_value((char) i);
+		CHECK(value >= -2 && value < 64, "decode value of %d is %d", i, value);
+	}
+}
+
+/* loads a route table from the given rules, returning -1 if they were rejected */
+static int load_routes(struct route_table *table, char *rules) {
+	char path[] = "/tmp/pulltab-routes-XXXXXX";
+	int fd = mkstemp(path);
+
+	if(fd < 0 || write(fd, rules, strlen(rules)) != (ssize_t) strlen(rules)) {
+		perror("test_parse");
+		exit(1);
+	}
+	close(fd);
+
+	route_table_init(table);
+	int ret = route_table_load(table, path);
+	unlink(path);
+	return ret;
+}
+
+static void test_routes(void) {
+	struct route_table table;
+	char *bad[] = { "10.0.0.0/abc direct\n", "10.0.0.0/ direct\n", "10.0.0.0/8x direct\n", "10.0.0.0/-0 direct\n",
+			"10.0.0.0/33 direct\n", "10.0.0.0/99999999999999999999 direct\n", "example.com/8 direct\n", NULL };
+	int i;
+
+	/* malformed prefix lengths must be rejected, not read as /0 */
+	for(i = 0; bad[i]; i++) {
+		CHECK(load_routes(&table, bad[i]) < 0, "accepted bad rule '%s'", bad[i]);
+		route_table_free(&table);
+	}
+
+	/* the tail of an over-long line mustn't become a rule of its own (here, a catch-all) */
+	char long_line[ROUTE_LINE_MAX + 64];
+	memset(long_line, '#', ROUTE_LINE_MAX);
+	strcpy(long_line + ROUTE_LINE_MAX - 8, " 0.0.0.0/0 direct\n");
+	CHECK(load_routes(&table, long_line) < 0, "accepted an over-long line");
+	CHECK(strstr(tab_strerror(), "line too long"), "unexpected error '%s'", tab_strerror());
+	CHECK(!route_lookup(&table, "8.8.8.8", NULL), "the tail of an over-long line became a rule");
+	route_table_free(&table);
+
+	/* the longest line that fits is fine, with or without a newline */
+	memset(long_line, '#', ROUTE_LINE_MAX - 2);
+	strcpy(long_line + ROUTE_LINE_MAX - 2, "\n");
+	CHECK(!load_routes(&table, long_line), "rejected a line which fits: %s", tab_strerror());
+	route_table_free(&table);
+	long_line[ROUTE_LINE_MAX - 2] = '\0';
+	CHECK(!load_routes(&table, long_line), "rejected a last line which fits: %s", tab_strerror());
+	route_table_free(&table);
+
+	CHECK(!load_routes(&table, "10.0.0.0/8 direct\n10.1.0.0/16 proxy p:1\n0.0.0.0/0 proxy q:2\n"), "%s", tab_strerror());
+
+	struct route *route = route_lookup(&table, "10.1.2.3", NULL);
+	CHECK(route && route->action == ROUTE_PROXY && route->proxy_port == 1, "10.1.0.0/16 should win");
+	route = route_lookup(&table, "10.2.3.4", NULL);
+	CHECK(route && route->action == ROUTE_DIRECT, "10.0.0.0/8 should win");
+	route = route_lookup(&table, "8.8.8.8", NULL);
+	CHECK(route && route->action == ROUTE_PROXY && route->proxy_port == 2, "0.0.0.0/0 should win");
+
+	/* names are left to the caller to resolve, and then matched against network rules */
+	struct in_addr addr;
+	int resolve = 0;
+	route = route_lookup(&table, "localhost", &resolve);
+	CHECK(!route && resolve, "localhost wasn't left to be resolved");
+	addr.s_addr = htonl(INADDR_LOOPBACK);
+	route = route_lookup_addr(&table, &addr);
+	CHECK(route && route->proxy_port == 2, "localhost should match 0.0.0.0/0");
+
+	route_table_free(&table);
+
+	CHECK(!load_routes(&table, ".example.com direct\ncorp.Example.COM. proxy p:1\nb.com proxy q:2\na.com direct\nc.com direct\n"), "%s", tab_strerror());
+
+	struct {
+		char *host;
+		int port;
+	} domains[] = {
+		{ "example.com", 0 },
+		{ "www.EXAMPLE.com.", 0 },
+		{ "corp.example.com", 1 },
+		{ "x.y.corp.example.com", 1 },
+		{ "notcorp.example.com", 0 },
+		{ "b.com", 2 },
+		{ "a.b.com", 2 },
+		{ "ab.com", -1 },
+		{ "com", -1 },
+		{ "example.org", -1 },
+		{ "", -1 },
+		{ NULL, 0 },
+	};
+
+	/* longest matching suffix, on label boundaries (port 0 meaning direct, -1 no match) */
+	for(i = 0; domains[i].host; i++) {
+		route = route_lookup(&table, domains[i].host, NULL);
+		if(domains[i].port < 0)
+			CHECK(!route, "'%s' matched rule '%s'", domains[i].host, route->rule);
+		else if(!domains[i].port)
+			CHECK(route && route->action == ROUTE_DIRECT, "'%s' should be direct", domains[i].host);
+		else
+			CHECK(route && route->proxy_port == domains[i].port, "'%s' should go via port %d", domains[i].host, domains[i].port);
+	}
+
+	/* without network rules, there's no point in resolving anything */
+	route = route_lookup(&table, "example.org", &resolve);
+	CHECK(!route && !resolve, "asked to resolve a name only domain rules apply to");
+
+	route_table_free(&table);
+}
+
+int main(int argc, char **argv) {
+	if(argc > 1)
+		rng_state = strtoul(argv[1], NULL, 0) | 1;
+
+	test_hostport();
+	test_auth();
+	test_proxy_response();
+	test_response_end();
+	test_base64();
+	test_routes();
+
+	if(failures) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("all parser property tests passed\n");
+	return 0;
+}
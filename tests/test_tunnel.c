@@ -0,0 +1,830 @@
+/* pulltab: tunnel arbitrary streams through HTTP proxies.
+ * Copyright (C) 2014 Aleksa Sarai
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* tests of the libpulltab connection API, against a proxy stand-in running in a child process. */
+
+#define _XOPEN_SOURCE
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "pulltab/pulltab.h"
+
+#if defined(WITH_TLS)
+#include <openssl/ssl.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if(!(cond)) { \
+			fprintf(stderr, "FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			failures++; \
+		} \
+	} while(0)
+
+/* listens on an ephemeral loopback port, returning the socket */
+static int stub_listen(int *port) {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if(bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0) {
+		perror("test_tunnel");
+		exit(1);
+	}
+	getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len);
+
+	*port = ntohs(addr.sin_port);
+	return listen_fd;
+}
+
+/* whether stub_proxy() lingers after saying goodbye, rather than closing the connection */
+static int stub_linger = 0;
+
+/* whether the stubs hang up as soon as they have answered, rather than echoing */
+static int stub_hangup = 0;
+
+/* starts a proxy stand-in which answers a single CONNECT with the given response (sent in one go,
+ * so anything after the headers arrives along with them), then echoes. if gate isn't -1, it waits
+ * for a byte from it before answering. once the client half-closes, it says "bye\n" and closes
+ * (or lingers until it's killed, if stub_linger is set). returns its port. */
+static int stub_proxy(char *response, int gate, pid_t *pid) {
+	int port;
+	int listen_fd = stub_listen(&port);
+
+	*pid = fork();
+	if(!*pid) {
+		char buf[4096];
+		int len = 0;
+		ssize_t n;
+
+		int fd = accept(listen_fd, NULL, NULL);
+		while(len < (int) sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+			len += n;
+			buf[len] = '\0';
+			if(strstr(buf, "\r\n\r\n"))
+				break;
+		}
+
+		char go;
+		if(gate >= 0 && read(gate, &go, 1) != 1)
+			_exit(1);
+
+		if(write(fd, response, strlen(response)) < 0 || stub_hangup)
+			_exit(1);
+
+		while((n = read(fd, buf, sizeof(buf))) > 0)
+			if(write(fd, buf, n) != n)
+				break;
+
+		if(!n && write(fd, "bye\n", 4) == 4 && stub_linger)
+			pause();
+		_exit(0);
+	}
+
+	close(listen_fd);
+	return port;
+}
+
+#if defined(WITH_TLS)
+
+/* self-signed certificate for "localhost" (generated for each run), and the CA file holding it */
+static EVP_PKEY *tls_key = NULL;
+static X509 *tls_cert = NULL;
+static char tls_ca_path[] = "/tmp/pulltab-ca-XXXXXX";
+
+static void tls_setup(void) {
+	tls_key = EVP_EC_gen("P-256");
+	tls_cert = X509_new();
+
+	X509_set_version(tls_cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(tls_cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(tls_cert), -60);
+	X509_gmtime_adj(X509_getm_notAfter(tls_cert), 3600);
+
+	X509_NAME *name = X509_get_subject_name(tls_cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char *) "localhost", -1, -1, 0);
+	X509_set_issuer_name(tls_cert, name);
+	X509_set_pubkey(tls_cert, tls_key);
+
+	X509_EXTENSION *ext = X509V3_EXT_conf_nid(NULL, NULL, NID_subject_alt_name, "DNS:localhost");
+	X509_add_ext(tls_cert, ext, -1);
+	X509_EXTENSION_free(ext);
+	ext = X509V3_EXT_conf_nid(NULL, NULL, NID_basic_constraints, "critical,CA:TRUE");
+	X509_add_ext(tls_cert, ext, -1);
+	X509_EXTENSION_free(ext);
+
+	int fd = mkstemp(tls_ca_path);
+	FILE *ca_file = fd < 0 ? NULL : fdopen(fd, "w");
+	if(!tls_key || !X509_sign(tls_cert, tls_key, EVP_sha256()) || !ca_file || !PEM_write_X509(ca_file, tls_cert)) {
+		fprintf(stderr, "test_tunnel: could not set up test certificate\n");
+		exit(1);
+	}
+	fclose(ca_file);
+}
+
+static void tls_teardown(void) {
+	unlink(tls_ca_path);
+	X509_free(tls_cert);
+	EVP_PKEY_free(tls_key);
+}
+
+/* the same as stub_proxy(), but TLS-terminating (using the test certificate) */
+static int stub_tls_proxy(char *response, pid_t *pid) {
+	int port;
+	int listen_fd = stub_listen(&port);
+
+	*pid = fork();
+	if(!*pid) {
+		char buf[4096];
+		int len = 0, n;
+
+		SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+		if(!ctx || !SSL_CTX_use_certificate(ctx, tls_cert) || !SSL_CTX_use_PrivateKey(ctx, tls_key))
+			_exit(1);
+
+		int fd = accept(listen_fd, NULL, NULL);
+		SSL *ssl = SSL_new(ctx);
+		SSL_set_fd(ssl, fd);
+
+		/* the client may well refuse the certificate, which is fine */
+		if(SSL_accept(ssl) != 1)
+			_exit(0);
+
+		while(len < (int) sizeof(buf) - 1 && (n = SSL_read(ssl, buf + len, sizeof(buf) - 1 - len)) > 0) {
+			len += n;
+			buf[len] = '\0';
+			if(strstr(buf, "\r\n\r\n"))
+				break;
+		}
+
+		if(SSL_write(ssl, response, strlen(response)) <= 0 || stub_hangup)
+			_exit(1);
+
+		while((n = SSL_read(ssl, buf, sizeof(buf))) > 0)
+			if(SSL_write(ssl, buf, n) != n)
+				break;
+		_exit(0);
+	}
+
+	close(listen_fd);
+	return port;
+}
+
+#endif
+
+static void stub_wait(pid_t pid) {
+	int status;
+	waitpid(pid, &status, 0);
+}
+
+static struct tab_opt *setup_opt(int port) {
+	struct tab_opt *opt = tab_opt_new();
+	char spec[64];
+
+	snprintf(spec, sizeof(spec), "127.0.0.1:%d", port);
+	tab_opt_set_proxy(opt, spec);
+	tab_opt_set_dest(opt, "example.com:22");
+	return opt;
+}
+
+static void test_blocking(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	char buf[64] = "";
+	pid_t pid;
+
+	/* the banner arrives along with the headers, and must not be lost */
+	int port = stub_proxy("HTTP/1.1 200 Connection established\r\nVia: stub\r\n\r\nbanner\n", -1, &pid);
+	opt = setup_opt(port);
+
+	int fd = tab_connect(opt, conn);
+	CHECK(fd >= 0, "tab_connect failed: %s", tab_strerror());
+
+	if(fd >= 0) {
+		ssize_t n = read(fd, buf, strlen("banner\n"));
+		CHECK(n == (ssize_t) strlen("banner\n") && !memcmp(buf, "banner\n", n), "lost data after the response headers");
+
+		CHECK(tab_write(conn, "ping", 4) == 4, "write failed");
+		n = tab_read(conn, buf, sizeof(buf));
+		CHECK(n == 4 && !memcmp(buf, "ping", 4), "echo through the tunnel failed");
+	}
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	stub_wait(pid);
+}
+
+static void test_async(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	pid_t pid;
+
+	int gate[2];
+	if(pipe(gate) < 0) {
+		perror("test_tunnel");
+		exit(1);
+	}
+
+	/* the proxy holds back its response until we say so, so there's bound to be something to wait for */
+	int port = stub_proxy("HTTP/1.0 200 OK\r\n\r\n", gate[0], &pid);
+	opt = setup_opt(port);
+
+	int ret = tab_connect_start(opt, conn);
+	CHECK(ret == TAB_WANT_READ || ret == TAB_WANT_WRITE, "async connect didn't wait for the proxy (%d)", ret);
+
+	if(write(gate[1], "", 1) != 1)
+		perror("test_tunnel");
+
+	while(ret == TAB_WANT_READ || ret == TAB_WANT_WRITE) {
+		struct pollfd pfd = { tab_conn_fd(conn), ret == TAB_WANT_READ ? POLLIN : POLLOUT, 0 };
+		poll(&pfd, 1, 5000);
+		ret = tab_connect_continue(opt, conn);
+	}
+
+	CHECK(ret == TAB_DONE, "async connect failed: %s", tab_strerror());
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	close(gate[0]);
+	close(gate[1]);
+	stub_wait(pid);
+}
+
+static void test_refused(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	pid_t pid;
+
+	int port = stub_proxy("HTTP/1.1 407 Proxy Authentication Required\r\n\r\n", -1, &pid);
+	opt = setup_opt(port);
+
+	CHECK(tab_connect(opt, conn) < 0, "407 treated as success");
+	CHECK(strstr(tab_strerror(), "Proxy Authentication Required"), "unexpected error '%s'", tab_strerror());
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	stub_wait(pid);
+}
+
+/* reads a whole file into buf (as a string) */
+static void read_file(char *path, char *buf, size_t len) {
+	buf[0] = '\0';
+
+	FILE *file = fopen(path, "r");
+	if(!file)
+		return;
+
+	size_t n = fread(buf, 1, len - 1, file);
+	buf[n] = '\0';
+	fclose(file);
+}
+
+static void test_trace_reuse(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	char buf[2048], spec[64], path[] = "/tmp/pulltab-trace-XXXXXX";
+	pid_t pid;
+	int i;
+
+	close(mkstemp(path));
+
+	opt = tab_opt_new();
+	tab_opt_set_dest(opt, "example.com:22");
+	tab_opt_set_trace(opt, path);
+
+	/* each connection made with the same options gets a trace of its own */
+	for(i = 0; i < 2; i++) {
+		int port = stub_proxy("HTTP/1.0 200 OK\r\n\r\n", -1, &pid);
+		snprintf(spec, sizeof(spec), "127.0.0.1:%d", port);
+		tab_opt_set_proxy(opt, spec);
+
+		CHECK(tab_connect(opt, conn) >= 0, "tab_connect failed: %s", tab_strerror());
+		CHECK(!tab_conn_trace(opt, conn, 0), "tab_conn_trace failed: %s", tab_strerror());
+
+		tab_conn_close(conn);
+		stub_wait(pid);
+	}
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	read_file(path, buf, sizeof(buf));
+	unlink(path);
+
+	char *second = strchr(buf, '\n');
+	CHECK(second && strchr(second + 1, '\n'), "expected two trace lines, got '%s'", buf);
+	if(second) {
+		char *start1 = strstr(buf, " start="), *start2 = strstr(second + 1, " start=");
+		CHECK(start1 && start2 && atoll(start1 + 7) != atoll(start2 + 7), "second trace repeats the first: '%s'", buf);
+	}
+}
+
+static void test_trace_unused(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	char path[] = "/tmp/pulltab-trace-XXXXXX";
+
+	int fd = mkstemp(path);
+	close(fd);
+
+	/* no tunnel was attempted, so there's nothing to trace */
+	opt = tab_opt_new();
+	tab_opt_set_trace(opt, path);
+	CHECK(!tab_conn_trace(opt, conn, 1), "tab_conn_trace failed: %s", tab_strerror());
+
+	struct stat st;
+	CHECK(!stat(path, &st) && !st.st_size, "trace written for a tunnel that never started");
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	unlink(path);
+}
+
+static long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/* shutdown signals received by the relay child (SIGUSR1 stands in for SIGTERM) */
+static volatile sig_atomic_t relay_drain = 0;
+
+static void relay_signal(int sig) {
+	(void) sig;
+	relay_drain++;
+}
+
+/* runs tab_relay() on a tunnel through the proxy at port (set up without blocking if async is set),
+ * from the pipe in to the pipe down, in a child process which exits with 0 if the relay did. like
+ * pulltab, its signal handler doesn't restart system calls. */
+static pid_t relay_start(int port, int drain_timeout, int async, int in[2], int down[2]) {
+	if(pipe(in) < 0 || pipe(down) < 0) {
+		perror("test_tunnel");
+		exit(1);
+	}
+
+	pid_t pid = fork();
+	if(!pid) {
+		int in_fd = in[0], out_fd = down[1];
+		struct rlimit rl;
+
+		/* the relay only ends when in_fd does, so it mustn't be holding the other end open */
+		close(in[1]);
+		close(down[0]);
+
+		/* fds past FD_SETSIZE have to work too (if we're allowed that many) */
+		if(!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_max > FD_SETSIZE + 2) {
+			rl.rlim_cur = FD_SETSIZE + 2;
+			if(!setrlimit(RLIMIT_NOFILE, &rl)) {
+				in_fd = fcntl(in_fd, F_DUPFD, FD_SETSIZE);
+				out_fd = fcntl(out_fd, F_DUPFD, FD_SETSIZE);
+			}
+		}
+
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = relay_signal;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGUSR1, &sa, NULL);
+
+		struct tab_opt *opt = setup_opt(port);
+		struct tab_conn *conn = tab_conn_new();
+		tab_opt_set_drain_timeout(opt, drain_timeout);
+
+		int ret;
+		if(async) {
+			/* which leaves the socket non-blocking, with a send buffer small enough to fill up */
+			ret = tab_connect_start(opt, conn);
+			while(ret == TAB_WANT_READ || ret == TAB_WANT_WRITE) {
+				struct pollfd pfd = { tab_conn_fd(conn), ret == TAB_WANT_READ ? POLLIN : POLLOUT, 0 };
+				poll(&pfd, 1, 5000);
+				ret = tab_connect_continue(opt, conn);
+			}
+
+			int sndbuf = 4096;
+			setsockopt(tab_conn_fd(conn), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+		} else {
+			ret = tab_connect(opt, conn);
+		}
+
+		if(ret >= 0)
+			ret = tab_relay(opt, conn, in_fd, out_fd, &relay_drain);
+
+		tab_conn_free(conn);
+		tab_opt_free(opt);
+		_exit(ret < 0);
+	}
+
+	close(in[0]);
+	close(down[1]);
+	return pid;
+}
+
+/* reads from fd into buf (as a string) until it has want bytes, or until EOF if want is 0 */
+static void read_until(int fd, char *buf, size_t len, size_t want) {
+	size_t got = strlen(buf);
+
+	while(got < len - 1 && (!want || got < want)) {
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		if(poll(&pfd, 1, 5000) <= 0)
+			break;
+
+		ssize_t n = read(fd, buf + got, len - 1 - got);
+		if(n <= 0)
+			break;
+
+		got += n;
+		buf[got] = '\0';
+	}
+}
+
+/* relays "ping" through the stub, then sends the relay the given number of shutdown signals (a
+ * moment apart) and collects what it wrote out in the meantime. returns how long the relay took to
+ * stop after the first signal, in milliseconds. */
+static long relay_run(int drain_timeout, int signals, char *out, size_t out_len, int *status) {
+	int in[2], down[2], i;
+	pid_t pid;
+
+	int port = stub_proxy("HTTP/1.0 200 OK\r\n\r\n", -1, &pid);
+	pid_t relay = relay_start(port, drain_timeout, 0, in, down);
+
+	/* the echo means the relay is up (and has its handler installed) */
+	out[0] = '\0';
+	if(write(in[1], "ping", 4) != 4)
+		perror("test_tunnel");
+	read_until(down[0], out, out_len, 4);
+
+	long start = now_ms();
+	for(i = 0; i < signals; i++) {
+		if(i)
+			usleep(100000);
+		kill(relay, SIGUSR1);
+	}
+
+	read_until(down[0], out, out_len, 0);
+	waitpid(relay, status, 0);
+	long elapsed = now_ms() - start;
+
+	close(in[1]);
+	close(down[0]);
+	kill(pid, SIGTERM);
+	stub_wait(pid);
+	return elapsed;
+}
+
+static void test_relay_drain(void) {
+	char out[64];
+	int status;
+
+	/* the proxy only sees EOF once we half-close, and what it sends after that still gets through */
+	long elapsed = relay_run(10, 1, out, sizeof(out), &status);
+	CHECK(!strcmp(out, "pingbye\n"), "unexpected data out of the relay: '%s'", out);
+	CHECK(WIFEXITED(status) && !WEXITSTATUS(status), "relay failed");
+	CHECK(elapsed < 5000, "relay kept going after EOF (%ldms)", elapsed);
+}
+
+static void test_relay_deadline(void) {
+	char out[64];
+	int status;
+
+	/* the proxy never closes, so the drain timeout has to end it */
+	stub_linger = 1;
+	long elapsed = relay_run(1, 1, out, sizeof(out), &status);
+	stub_linger = 0;
+
+	CHECK(!strcmp(out, "pingbye\n"), "unexpected data out of the relay: '%s'", out);
+	CHECK(WIFEXITED(status) && !WEXITSTATUS(status), "relay failed");
+	CHECK(elapsed >= 900 && elapsed < 3000, "relay didn't stop at the drain deadline (%ldms)", elapsed);
+}
+
+static void test_relay_force(void) {
+	char out[64];
+	int status;
+
+	/* a second signal doesn't wait for the (long) drain timeout */
+	stub_linger = 1;
+	long elapsed = relay_run(10, 2, out, sizeof(out), &status);
+	stub_linger = 0;
+
+	CHECK(WIFEXITED(status) && !WEXITSTATUS(status), "relay failed");
+	CHECK(elapsed < 2000, "second signal didn't force the relay to stop (%ldms)", elapsed);
+}
+
+#define RELAY_BULK (1 << 20)
+
+static void test_relay_nonblocking(void) {
+	char buf[4096];
+	int in[2], down[2], status;
+	size_t got = 0, bad = 0, i;
+	pid_t pid, writer;
+
+	int port = stub_proxy("HTTP/1.0 200 OK\r\n\r\n", -1, &pid);
+	pid_t relay = relay_start(port, 10, 1, in, down);
+
+	/* push more through than fits in the socket buffers, so writes are bound to come up short (or
+	 * not go through at all) while we read the echo */
+	writer = fork();
+	if(!writer) {
+		for(i = 0; i < RELAY_BULK; i += sizeof(buf)) {
+			size_t j;
+			for(j = 0; j < sizeof(buf); j++)
+				buf[j] = (i + j) % 251;
+			if(write(in[1], buf, sizeof(buf)) != sizeof(buf))
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	while(got < RELAY_BULK) {
+		struct pollfd pfd = { down[0], POLLIN, 0 };
+		if(poll(&pfd, 1, 5000) <= 0)
+			break;
+
+		ssize_t n = read(down[0], buf, sizeof(buf));
+		if(n <= 0)
+			break;
+
+		for(i = 0; i < (size_t) n; i++)
+			bad += (unsigned char) buf[i] != (got + i) % 251;
+		got += n;
+	}
+
+	CHECK(got == RELAY_BULK && !bad, "relayed %zu of %d bytes (%zu wrong) through a non-blocking tunnel", got, RELAY_BULK, bad);
+
+	/* closing our end of in_fd ends the relay (or makes sure it has, if it stalled) */
+	if(got < RELAY_BULK) {
+		kill(writer, SIGKILL);
+		kill(relay, SIGKILL);
+	}
+	stub_wait(writer);
+	close(in[1]);
+	waitpid(relay, &status, 0);
+	CHECK(WIFEXITED(status) && !WEXITSTATUS(status), "relay failed");
+
+	close(down[0]);
+	stub_wait(pid);
+}
+
+static void test_connect_interrupted(void) {
+	struct sigaction sa, old;
+	int gate[2], status;
+	pid_t pid;
+
+	if(pipe(gate) < 0) {
+		perror("test_tunnel");
+		exit(1);
+	}
+
+	/* set before forking, so the signal can't get to the child before its handler does */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = relay_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, &old);
+
+	/* the proxy holds back its response, so tab_connect() is waiting in poll() when the signal comes */
+	int port = stub_proxy("HTTP/1.0 200 OK\r\n\r\n", gate[0], &pid);
+	pid_t child = fork();
+	if(!child) {
+		struct tab_opt *opt = setup_opt(port);
+		struct tab_conn *conn = tab_conn_new();
+		_exit(tab_connect(opt, conn) < 0);
+	}
+
+	usleep(100000);
+	kill(child, SIGUSR1);
+	usleep(100000);
+	if(write(gate[1], "", 1) != 1)
+		perror("test_tunnel");
+
+	waitpid(child, &status, 0);
+	CHECK(WIFEXITED(status) && !WEXITSTATUS(status), "tab_connect gave up on a signal");
+
+	sigaction(SIGUSR1, &old, NULL);
+	close(gate[0]);
+	close(gate[1]);
+	stub_wait(pid);
+}
+
+/* writes to a tunnel (through opt) whose proxy hangs up after answering, in a child process so that
+ * a SIGPIPE can't take the tests down with it */
+static void check_hangup(struct tab_opt *opt, char *what) {
+	int status;
+
+	pid_t child = fork();
+	if(!child) {
+		struct tab_conn *conn = tab_conn_new();
+		int i, failed = 0;
+
+		if(tab_connect(opt, conn) < 0)
+			_exit(2);
+
+		/* the first write after the proxy goes away can still succeed (it's what gets the reset) */
+		for(i = 0; i < 50 && failed < 2; i++) {
+			if(tab_write(conn, "ping", 4) < 0)
+				failed++;
+			usleep(10000);
+		}
+		_exit(failed < 2 ? 3 : 0);
+	}
+
+	waitpid(child, &status, 0);
+	CHECK(!WIFSIGNALED(status), "writing to a %s tunnel which had gone away raised signal %d", what, WTERMSIG(status));
+	CHECK(WIFSIGNALED(status) || !WEXITSTATUS(status), "writing to a %s tunnel which had gone away didn't fail (%d)", what, WEXITSTATUS(status));
+}
+
+static void test_hangup(void) {
+	pid_t pid;
+
+	stub_hangup = 1;
+	int port = stub_proxy("HTTP/1.0 200 OK\r\n\r\n", -1, &pid);
+	stub_hangup = 0;
+
+	struct tab_opt *opt = setup_opt(port);
+	check_hangup(opt, "plaintext");
+	tab_opt_free(opt);
+	stub_wait(pid);
+}
+
+#if defined(WITH_TLS)
+
+static void test_tls(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	char buf[1024] = "", spec[64], trace_path[] = "/tmp/pulltab-trace-XXXXXX";
+	int n = 0, got = 0;
+	pid_t pid;
+
+	close(mkstemp(trace_path));
+
+	/* the banner is in the same TLS record as the headers, so it has to survive being peeked at */
+	int port = stub_tls_proxy("HTTP/1.1 200 Connection established\r\n\r\nbanner\n", &pid);
+
+	opt = tab_opt_new();
+	snprintf(spec, sizeof(spec), "localhost:%d", port);
+	tab_opt_set_proxy(opt, spec);
+	tab_opt_set_dest(opt, "example.com:22");
+	CHECK(!tab_opt_set_tls(opt, tls_ca_path), "tab_opt_set_tls failed: %s", tab_strerror());
+	tab_opt_set_trace(opt, trace_path);
+
+	/* go through the non-blocking handshake */
+	int ret = tab_connect_start(opt, conn), rounds = 0;
+	while(ret == TAB_WANT_READ || ret == TAB_WANT_WRITE) {
+		struct pollfd pfd = { tab_conn_fd(conn), ret == TAB_WANT_READ ? POLLIN : POLLOUT, 0 };
+		poll(&pfd, 1, 5000);
+		ret = tab_connect_continue(opt, conn);
+		rounds++;
+	}
+
+	CHECK(ret == TAB_DONE, "TLS connect failed: %s", tab_strerror());
+	CHECK(rounds > 0, "TLS connect never waited");
+	CHECK(tab_conn_tls(conn), "tunnel isn't using TLS");
+
+	if(ret == TAB_DONE) {
+		CHECK(tab_write(conn, "ping", 4) == 4, "write failed");
+
+		/* the socket is still non-blocking, so wait for both the banner and the echo */
+		while(got < (int) strlen("banner\nping")) {
+			struct pollfd pfd = { tab_conn_fd(conn), POLLIN, 0 };
+			if(poll(&pfd, 1, 5000) <= 0)
+				break;
+
+			n = tab_read(conn, buf + got, sizeof(buf) - 1 - got);
+			if(n < 0 && errno == EAGAIN)
+				continue;
+			if(n <= 0)
+				break;
+			got += n;
+		}
+
+		buf[got] = '\0';
+		CHECK(!strcmp(buf, "banner\nping"), "unexpected data through the TLS tunnel: '%s'", buf);
+	}
+
+	CHECK(!tab_conn_trace(opt, conn, ret != TAB_DONE), "tab_conn_trace failed: %s", tab_strerror());
+	read_file(trace_path, buf, sizeof(buf));
+	CHECK(strstr(buf, " ktls=") && !strstr(buf, " tls_us=-1 "), "TLS missing from trace '%s'", buf);
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	unlink(trace_path);
+	stub_wait(pid);
+}
+
+static void test_tls_untrusted(void) {
+	struct tab_opt *opt;
+	struct tab_conn *conn = tab_conn_new();
+	char spec[64];
+	pid_t pid;
+
+	int port = stub_tls_proxy("HTTP/1.1 200 Connection established\r\n\r\n", &pid);
+
+	opt = tab_opt_new();
+	snprintf(spec, sizeof(spec), "localhost:%d", port);
+	tab_opt_set_proxy(opt, spec);
+	tab_opt_set_dest(opt, "example.com:22");
+
+	/* the CAs are loaded up front, so a bad CA file doesn't wait for a connection to show up */
+	CHECK(tab_opt_set_tls(opt, "/nonexistent/ca.pem") < 0, "missing CA file accepted");
+	CHECK(strstr(tab_strerror(), "could not load CA file"), "unexpected error '%s'", tab_strerror());
+
+	/* the test certificate isn't in the system's CAs */
+	CHECK(!tab_opt_set_tls(opt, NULL), "tab_opt_set_tls failed: %s", tab_strerror());
+
+	CHECK(tab_connect(opt, conn) < 0, "untrusted certificate accepted");
+	CHECK(strstr(tab_strerror(), "could not verify proxy certificate"), "unexpected error '%s'", tab_strerror());
+
+	tab_conn_free(conn);
+	tab_opt_free(opt);
+	stub_wait(pid);
+}
+
+static void test_tls_hangup(void) {
+	char spec[64];
+	pid_t pid;
+
+	stub_hangup = 1;
+	int port = stub_tls_proxy("HTTP/1.1 200 Connection established\r\n\r\n", &pid);
+	stub_hangup = 0;
+
+	struct tab_opt *opt = tab_opt_new();
+	snprintf(spec, sizeof(spec), "localhost:%d", port);
+	tab_opt_set_proxy(opt, spec);
+	tab_opt_set_dest(opt, "example.com:22");
+	tab_opt_set_tls(opt, tls_ca_path);
+
+	check_hangup(opt, "TLS");
+	tab_opt_free(opt);
+	stub_wait(pid);
+}
+
+#endif
+
+int main(void) {
+	test_blocking();
+	test_async();
+	test_refused();
+	test_trace_reuse();
+	test_trace_unused();
+	test_relay_drain();
+	test_relay_deadline();
+	test_relay_force();
+	test_relay_nonblocking();
+	test_connect_interrupted();
+	test_hangup();
+
+#if defined(WITH_TLS)
+	tls_setup();
+	test_tls();
+	test_tls_untrusted();
+	test_tls_hangup();
+	tls_teardown();
+#endif
+
+	if(failures) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("all tunnel tests passed\n");
+	return 0;
+}